@@ -0,0 +1,535 @@
+#include "Capture.h"
+#include "SoftwareRenderer.h"
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <array>
+#include <map>
+#include <typeinfo>
+
+// Buffer contents are kept 16-byte aligned in the file, so the replay can use them in place
+static constexpr std::size_t BUFFER_ALIGNMENT = 16;
+
+static uint64_t hashContent(const void* data, std::size_t size)
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+	uint64_t hash = 0xCBF29CE484222325ull ^ size;
+	for (std::size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	return hash;
+}
+
+static const char* shaderName(IShader* shader)
+{
+	return typeid(*shader).name();
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	if (file)
+		fclose(file);
+}
+
+bool CaptureWriter::open(const char* path, int w, int h, PixelFormat format, int frames)
+{
+	assert(!file && frames > 0 && "Invalid capture!");
+
+	file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	framesLeft = frames;
+	writeValue(MAGIC);
+	writeValue(VERSION);
+	writeValue(int32_t(w));
+	writeValue(int32_t(h));
+	writeValue(uint32_t(format));
+	return true;
+}
+
+void CaptureWriter::writeOp(CaptureOp op)
+{
+	writeValue(static_cast<uint32_t>(op));
+}
+
+void CaptureWriter::writeBytes(const void* data, std::size_t size)
+{
+	if (size)
+		fwrite(data, 1, size, file);
+}
+
+uint32_t CaptureWriter::writeBuffer(const void* data, std::size_t size)
+{
+	const uint64_t hash = hashContent(data, size);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+	auto range = bufferIds.equal_range(hash);
+	for (auto found = range.first; found != range.second; ++found) {
+		const auto& content = bufferContents[found->second];
+		if (content.size() == size && (size == 0 || std::memcmp(content.data(), data, size) == 0))
+			return found->second;
+	}
+
+	const uint32_t id = static_cast<uint32_t>(bufferContents.size());
+	bufferIds.emplace(hash, id);
+	bufferContents.emplace_back(bytes, bytes + size);
+
+	writeOp(CaptureOp::BUFFER);
+	writeValue(id);
+	writeValue(uint64_t(size));
+
+	static const uint8_t padding[BUFFER_ALIGNMENT] = {};
+	const std::size_t position = static_cast<std::size_t>(ftell(file));
+	writeBytes(padding, (BUFFER_ALIGNMENT - position % BUFFER_ALIGNMENT) % BUFFER_ALIGNMENT);
+	writeBytes(data, size);
+	return id;
+}
+
+void CaptureWriter::recordDepthBuffer(DepthFormat format, bool tileCompression, SurfaceLayout layout)
+{
+	writeOp(CaptureOp::DEPTH_BUFFER);
+	writeValue(uint32_t(format));
+	writeValue(uint32_t(tileCompression));
+	writeValue(uint32_t(layout));
+}
+
+void CaptureWriter::recordColorLayout(SurfaceLayout layout)
+{
+	writeOp(CaptureOp::COLOR_LAYOUT);
+	writeValue(uint32_t(layout));
+}
+
+void CaptureWriter::recordClearColor(const float color[4])
+{
+	writeOp(CaptureOp::CLEAR_COLOR);
+	writeBytes(color, 4 * sizeof(float));
+}
+
+void CaptureWriter::recordOp(CaptureOp op)
+{
+	writeOp(op);
+}
+
+void CaptureWriter::writeState(IShader* shader, const PipelineStateDesc& pipeline)
+{
+	const auto& desc = shader->getDesc();
+
+	if (shader != lastShader) {
+		const char* name = shaderName(shader);
+		writeOp(CaptureOp::SHADER);
+		writeValue(uint32_t(std::strlen(name)));
+		writeBytes(name, std::strlen(name));
+		writeValue(uint64_t(desc.inputVertexSize));
+		lastShader = shader;
+		constantsWritten = false;
+	}
+
+	const bool pipelineChanged = !pipelineWritten ||
+		pipeline.drawStyle != lastPipeline.drawStyle || pipeline.backfaceCull != lastPipeline.backfaceCull ||
+		pipeline.sampleDensity != lastPipeline.sampleDensity || pipeline.zBufferEnabled != lastPipeline.zBufferEnabled ||
+		pipeline.depthFormat != lastPipeline.depthFormat || pipeline.perspectiveCorrect != lastPipeline.perspectiveCorrect ||
+		pipeline.colorWrite != lastPipeline.colorWrite || pipeline.depthWrite != lastPipeline.depthWrite ||
+		pipeline.depthFunc != lastPipeline.depthFunc;
+
+	if (pipelineChanged) {
+		writeOp(CaptureOp::PIPELINE);
+		writeValue(uint32_t(pipeline.drawStyle));
+		writeValue(uint32_t(pipeline.backfaceCull));
+		writeValue(uint32_t(pipeline.sampleDensity));
+		writeValue(uint32_t(pipeline.zBufferEnabled));
+		writeValue(uint32_t(pipeline.depthFormat));
+		writeValue(uint32_t(pipeline.perspectiveCorrect));
+		writeValue(uint32_t(pipeline.colorWrite));
+		writeValue(uint32_t(pipeline.depthWrite));
+		writeValue(uint32_t(pipeline.depthFunc));
+		lastPipeline = pipeline;
+		pipelineWritten = true;
+	}
+
+	const auto constants = shader->getConstants();
+	assert(constants.data != nullptr && "Shader does not expose its constants, it cannot be captured!");
+	const uint8_t* constantBytes = reinterpret_cast<const uint8_t*>(constants.data);
+
+	if (!constantsWritten || constants.size != lastConstants.size() ||
+		std::memcmp(constants.data, lastConstants.data(), constants.size) != 0) {
+		writeOp(CaptureOp::CONSTANTS);
+		writeValue(uint64_t(constants.size));
+		writeBytes(constants.data, constants.size);
+		lastConstants.assign(constantBytes, constantBytes + constants.size);
+		constantsWritten = true;
+	}
+}
+
+void CaptureWriter::recordDraw(IShader* shader, const PipelineStateDesc& pipeline, const void* vertices, std::size_t vertexCount,
+	const uint32_t* indices, std::size_t indexCount)
+{
+	writeState(shader, pipeline);
+
+	const uint32_t vertexBuffer = writeBuffer(vertices, vertexCount * shader->getDesc().inputVertexSize);
+
+	if (indices) {
+		const uint32_t indexBuffer = writeBuffer(indices, indexCount * sizeof(uint32_t));
+		writeOp(CaptureOp::DRAW_INDEXED);
+		writeValue(vertexBuffer);
+		writeValue(uint64_t(vertexCount));
+		writeValue(indexBuffer);
+		writeValue(uint64_t(indexCount));
+	}
+	else {
+		writeOp(CaptureOp::DRAW);
+		writeValue(vertexBuffer);
+		writeValue(uint64_t(vertexCount));
+	}
+}
+
+void CaptureWriter::recordMeshletDraw(IShader* shader, const PipelineStateDesc& pipeline, const void* vertices, std::size_t vertexCount,
+	const MeshletMesh& mesh, const Eigen::Matrix4f& objectToClip)
+{
+	writeState(shader, pipeline);
+
+	const uint32_t vertexBuffer = writeBuffer(vertices, vertexCount * shader->getDesc().inputVertexSize);
+	const uint32_t tables[5] = {
+		writeBuffer(mesh.getMeshlets()),
+		writeBuffer(mesh.getVertices()),
+		writeBuffer(mesh.getTriangles()),
+		writeBuffer(mesh.getPrimitives()),
+		writeBuffer(mesh.getIndices()),
+	};
+
+	writeOp(CaptureOp::DRAW_MESHLETS);
+	writeValue(vertexBuffer);
+	writeValue(uint64_t(vertexCount));
+	writeBytes(tables, sizeof(tables));
+	writeBytes(objectToClip.data(), 16 * sizeof(float));
+}
+
+bool CaptureWriter::endFrame()
+{
+	writeOp(CaptureOp::END_FRAME);
+
+	if (--framesLeft > 0)
+		return false;
+
+	fclose(file);
+	file = nullptr;
+	return true;
+}
+
+bool CaptureReplayer::load(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	data.clear();
+	uint8_t chunk[4096];
+	std::size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + read);
+	fclose(file);
+
+	commands.clear();
+	bufferOffsets.clear();
+	bufferSizes.clear();
+	meshletMeshes.clear();
+	std::map<std::array<uint32_t, 5>, std::shared_ptr<const MeshletMesh>> meshletCache;
+
+	std::size_t position = 0;
+	bool valid = true;
+
+	auto take = [&](uint64_t size) {
+		const std::size_t offset = position;
+		if (size > data.size() - position)
+			valid = false;
+		else
+			position += size;
+		return offset;
+	};
+	auto read32 = [&]() {
+		uint32_t value = 0;
+		const std::size_t offset = take(sizeof(value));
+		if (valid)
+			std::memcpy(&value, data.data() + offset, sizeof(value));
+		return value;
+	};
+	auto read64 = [&]() {
+		uint64_t value = 0;
+		const std::size_t offset = take(sizeof(value));
+		if (valid)
+			std::memcpy(&value, data.data() + offset, sizeof(value));
+		return value;
+	};
+
+	if (read32() != CaptureWriter::MAGIC || read32() != CaptureWriter::VERSION)
+		return false;
+	w = static_cast<int32_t>(read32());
+	h = static_cast<int32_t>(read32());
+	format = static_cast<PixelFormat>(read32());
+
+	// Draws may only reference buffers already loaded, large enough for what they read
+	bool shaderBound = false;
+	std::size_t vertexSize = 0;
+	auto checkBuffer = [&](uint32_t id, uint64_t count, std::size_t elementSize) {
+		if (!shaderBound || id >= bufferSizes.size() || (elementSize != 0 && count > bufferSizes[id] / elementSize))
+			valid = false;
+	};
+
+	while (valid && position < data.size()) {
+		const auto op = static_cast<CaptureOp>(read32());
+		commands.push_back({ op, position });
+
+		switch (op) {
+		case CaptureOp::DEPTH_BUFFER:		take(3 * sizeof(uint32_t)); break;
+		case CaptureOp::COLOR_LAYOUT:		take(sizeof(uint32_t)); break;
+		case CaptureOp::CLEAR_COLOR:		take(4 * sizeof(float)); break;
+		case CaptureOp::CLEAR:
+		case CaptureOp::CLEAR_ZBUFFER:
+		case CaptureOp::BEGIN_FRAME:
+		case CaptureOp::END_FRAME:
+		case CaptureOp::INVALIDATE_FRAME:
+		case CaptureOp::RESOLVE:			break;
+		case CaptureOp::BUFFER: {
+			const uint32_t id = read32();
+			const uint64_t size = read64();
+			take((BUFFER_ALIGNMENT - position % BUFFER_ALIGNMENT) % BUFFER_ALIGNMENT);
+			if (id != bufferOffsets.size())
+				valid = false;
+			bufferOffsets.push_back(take(size));
+			bufferSizes.push_back(size);
+			break;
+		}
+		case CaptureOp::SHADER:
+			take(read32());
+			vertexSize = static_cast<std::size_t>(read64());
+			shaderBound = true;
+			break;
+		case CaptureOp::PIPELINE:			take(9 * sizeof(uint32_t)); break;
+		case CaptureOp::CONSTANTS:
+			take(read64());
+			// Constants are given to the shader bound last
+			if (!shaderBound)
+				valid = false;
+			break;
+		case CaptureOp::DRAW: {
+			const uint32_t vertexBuffer = read32();
+			checkBuffer(vertexBuffer, read64(), vertexSize);
+			break;
+		}
+		case CaptureOp::DRAW_INDEXED: {
+			const uint32_t vertexBuffer = read32();
+			const uint64_t vertexCount = read64();
+			const uint32_t indexBuffer = read32();
+			const uint64_t indexCount = read64();
+			checkBuffer(vertexBuffer, vertexCount, vertexSize);
+			checkBuffer(indexBuffer, indexCount, sizeof(uint32_t));
+			if (!valid)
+				break;
+
+			const uint8_t* indices = data.data() + bufferOffsets[indexBuffer];
+			for (uint64_t i = 0; i < indexCount && valid; ++i) {
+				uint32_t index;
+				std::memcpy(&index, indices + i * sizeof(index), sizeof(index));
+				valid = index < vertexCount;
+			}
+			break;
+		}
+		case CaptureOp::DRAW_MESHLETS: {
+			const uint32_t vertexBuffer = read32();
+			const uint64_t vertexCount = read64();
+			checkBuffer(vertexBuffer, vertexCount, vertexSize);
+			std::array<uint32_t, 5> tables;
+			for (uint32_t& table : tables)
+				table = read32();
+			take(16 * sizeof(float));
+			if (!valid)
+				break;
+
+			// Meshes are rebuilt once, not in the timed frames
+			auto& mesh = meshletCache[tables];
+			if (!mesh)
+				mesh = loadMeshletMesh(tables.data(), vertexCount);
+			if (!mesh)
+				valid = false;
+			meshletMeshes.push_back(mesh);
+			break;
+		}
+		default:							valid = false; break;
+		}
+	}
+
+	return valid && w > 0 && h > 0;
+}
+
+template <typename T>
+static bool readTable(const std::vector<uint8_t>& data, std::size_t offset, std::size_t size, std::vector<T>& table)
+{
+	if (size % sizeof(T) != 0)
+		return false;
+	table.resize(size / sizeof(T));
+	std::memcpy(static_cast<void*>(table.data()), data.data() + offset, size);
+	return true;
+}
+
+std::shared_ptr<const MeshletMesh> CaptureReplayer::loadMeshletMesh(const uint32_t tables[5], std::size_t vertexCount) const
+{
+	for (int i = 0; i < 5; ++i)
+		if (tables[i] >= bufferOffsets.size())
+			return nullptr;
+
+	std::vector<MeshletMesh::Meshlet> meshlets;
+	std::vector<uint32_t> vertices;
+	std::vector<uint8_t> triangles;
+	std::vector<uint32_t> primitives;
+	std::vector<uint32_t> indices;
+	if (!readTable(data, bufferOffsets[tables[0]], bufferSizes[tables[0]], meshlets) ||
+		!readTable(data, bufferOffsets[tables[1]], bufferSizes[tables[1]], vertices) ||
+		!readTable(data, bufferOffsets[tables[2]], bufferSizes[tables[2]], triangles) ||
+		!readTable(data, bufferOffsets[tables[3]], bufferSizes[tables[3]], primitives) ||
+		!readTable(data, bufferOffsets[tables[4]], bufferSizes[tables[4]], indices) ||
+		triangles.size() != primitives.size() * 3)
+		return nullptr;
+
+	// The renderer trusts the tables, a corrupt capture must not index out of them
+	for (const auto& meshlet : meshlets) {
+		if (std::size_t(meshlet.vertexOffset) + meshlet.vertexCount > vertices.size() ||
+			std::size_t(meshlet.triangleOffset) + meshlet.triangleCount > primitives.size())
+			return nullptr;
+		for (uint32_t i = 0; i < meshlet.triangleCount * 3; ++i)
+			if (triangles[meshlet.triangleOffset * 3 + i] >= meshlet.vertexCount)
+				return nullptr;
+	}
+	for (uint32_t vertex : vertices)
+		if (vertex >= vertexCount)
+			return nullptr;
+
+	return std::make_shared<const MeshletMesh>(std::move(meshlets), std::move(vertices), std::move(triangles),
+		std::move(primitives), std::move(indices));
+}
+
+void CaptureReplayer::registerShader(IShader* shader)
+{
+	shaders[shaderName(shader)] = shader;
+}
+
+bool CaptureReplayer::replay(SoftwareRenderer& renderer, std::vector<double>& frameTimes, std::string& error)
+{
+	assert(renderer.getWidth() == w && renderer.getHeight() == h && renderer.getPixelFormat() == format
+		&& "Renderer does not match the capture!");
+
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point frameStart = Clock::now();
+
+	IShader* shader = nullptr;
+	std::size_t meshletDraws = 0;
+	frameTimes.clear();
+
+	for (const Command& command : commands) {
+		const uint8_t* payload = data.data() + command.offset;
+		auto read32 = [&payload]() { uint32_t v; std::memcpy(&v, payload, sizeof(v)); payload += sizeof(v); return v; };
+		auto read64 = [&payload]() { uint64_t v; std::memcpy(&v, payload, sizeof(v)); payload += sizeof(v); return v; };
+
+		switch (command.op) {
+		case CaptureOp::DEPTH_BUFFER: {
+			const auto depthFormat = static_cast<DepthFormat>(read32());
+			const bool tileCompression = read32() != 0;
+			const auto layout = static_cast<SurfaceLayout>(read32());
+			auto current = renderer.getDepthBuffer();
+			if (current->getFormat() != depthFormat || current->isTileCompressionEnabled() != tileCompression || current->getLayout() != layout)
+				renderer.setDepthBuffer(std::make_shared<DepthBuffer>(w, h, depthFormat, tileCompression, layout));
+			break;
+		}
+		case CaptureOp::COLOR_LAYOUT: {
+			const auto layout = static_cast<SurfaceLayout>(read32());
+			if (renderer.getColorLayout() != layout)
+				renderer.setColorLayout(layout);
+			break;
+		}
+		case CaptureOp::CLEAR_COLOR: {
+			float color[4];
+			std::memcpy(color, payload, sizeof(color));
+			renderer.setClearColor(Eigen::Vector4f::Map(color));
+			break;
+		}
+		case CaptureOp::CLEAR:				renderer.clear(); break;
+		case CaptureOp::CLEAR_ZBUFFER:		renderer.clearZBuffer(); break;
+		case CaptureOp::BEGIN_FRAME:
+			frameStart = Clock::now();
+			renderer.beginFrame();
+			break;
+		case CaptureOp::END_FRAME:
+			renderer.endFrame();
+			frameTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+			break;
+		case CaptureOp::INVALIDATE_FRAME:	renderer.invalidateFrame(); break;
+		case CaptureOp::RESOLVE:			renderer.resolve(); break;
+		case CaptureOp::BUFFER:				break;
+		case CaptureOp::SHADER: {
+			const uint32_t length = read32();
+			const std::string name(reinterpret_cast<const char*>(payload), length);
+			payload += length;
+			const std::size_t vertexSize = static_cast<std::size_t>(read64());
+
+			auto found = shaders.find(name);
+			if (found == shaders.end()) {
+				error = "shader " + name + " is not registered";
+				return false;
+			}
+			if (found->second->getDesc().inputVertexSize != vertexSize) {
+				error = "shader " + name + " does not match the captured vertex size";
+				return false;
+			}
+			shader = found->second;
+			renderer.bindShader(shader);
+			break;
+		}
+		case CaptureOp::PIPELINE: {
+			PipelineStateDesc desc;
+			desc.drawStyle = static_cast<DrawStyle>(read32());
+			desc.backfaceCull = read32() != 0;
+			desc.sampleDensity = static_cast<uint8_t>(read32());
+			desc.zBufferEnabled = read32() != 0;
+			desc.depthFormat = static_cast<DepthFormat>(read32());
+			desc.perspectiveCorrect = read32() != 0;
+			desc.colorWrite = read32() != 0;
+			desc.depthWrite = read32() != 0;
+			desc.depthFunc = static_cast<DepthFunc>(read32());
+			renderer.bindPipelineState(PipelineState::create(desc));
+			break;
+		}
+		case CaptureOp::CONSTANTS: {
+			const std::size_t size = static_cast<std::size_t>(read64());
+			shader->setConstants(payload, size);
+			break;
+		}
+		case CaptureOp::DRAW: {
+			const uint32_t vertexBuffer = read32();
+			const std::size_t vertexCount = static_cast<std::size_t>(read64());
+			renderer.setVertexArray(data.data() + bufferOffsets[vertexBuffer], vertexCount);
+			renderer.draw();
+			break;
+		}
+		case CaptureOp::DRAW_INDEXED: {
+			const uint32_t vertexBuffer = read32();
+			const std::size_t vertexCount = static_cast<std::size_t>(read64());
+			const uint32_t indexBuffer = read32();
+			const std::size_t indexCount = static_cast<std::size_t>(read64());
+			renderer.setVertexArray(data.data() + bufferOffsets[vertexBuffer], vertexCount);
+			renderer.drawIndexed(reinterpret_cast<const uint32_t*>(data.data() + bufferOffsets[indexBuffer]), indexCount);
+			break;
+		}
+		case CaptureOp::DRAW_MESHLETS: {
+			const uint32_t vertexBuffer = read32();
+			const std::size_t vertexCount = static_cast<std::size_t>(read64());
+			payload += 5 * sizeof(uint32_t);
+			float objectToClip[16];
+			std::memcpy(objectToClip, payload, sizeof(objectToClip));
+			renderer.setVertexArray(data.data() + bufferOffsets[vertexBuffer], vertexCount);
+			renderer.drawMeshlets(*meshletMeshes[meshletDraws++], Eigen::Matrix4f::Map(objectToClip));
+			break;
+		}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include "IShader.h"
+#include "PixelFormat.h"
+#include "DepthBuffer.h"
+#include "PipelineState.h"
+#include "MeshletMesh.h"
+
+class SoftwareRenderer;
+
+// Binary stream of renderer calls. Every record is an op code followed by its payload,
+// buffers are written once per distinct content and referenced by id afterwards.
+enum class CaptureOp : uint32_t {
+	DEPTH_BUFFER,		// DepthFormat, tile compression, SurfaceLayout
+	COLOR_LAYOUT,		// SurfaceLayout
+	CLEAR_COLOR,		// 4 floats
+	CLEAR,
+	CLEAR_ZBUFFER,
+	BEGIN_FRAME,
+	END_FRAME,
+	INVALIDATE_FRAME,
+	RESOLVE,
+	BUFFER,				// id, size, bytes
+	SHADER,				// name, input vertex size
+	PIPELINE,			// PipelineStateDesc fields
+	CONSTANTS,			// size, bytes
+	DRAW,				// vertex buffer id, vertex count
+	DRAW_INDEXED,		// vertex buffer id, vertex count, index buffer id, index count
+	DRAW_MESHLETS,		// vertex buffer id, vertex count, buffer ids of the meshlet, vertex, triangle,
+						// primitive and index tables, object to clip transform
+};
+
+// Written by SoftwareRenderer::startCapture(), with the inputs of every call read when it is made
+class CaptureWriter
+{
+	FILE* file = nullptr;
+	int framesLeft = 0;
+
+	// Ids of the written buffers by content hash, colliding contents are told apart by their bytes
+	std::unordered_multimap<uint64_t, uint32_t> bufferIds;
+	std::vector<std::vector<uint8_t>> bufferContents;
+	IShader* lastShader = nullptr;
+	PipelineStateDesc lastPipeline;
+	bool pipelineWritten = false;
+	std::vector<uint8_t> lastConstants;
+	bool constantsWritten = false;
+
+	void writeOp(CaptureOp op);
+	void writeBytes(const void* data, std::size_t size);
+	template <typename T>
+	void writeValue(const T& value) { writeBytes(&value, sizeof(value)); }
+	uint32_t writeBuffer(const void* data, std::size_t size);
+	template <typename T>
+	uint32_t writeBuffer(const std::vector<T>& values) { return writeBuffer(values.data(), values.size() * sizeof(T)); }
+	void writeState(IShader* shader, const PipelineStateDesc& pipeline);
+
+public:
+	static constexpr uint32_t MAGIC = 0x50435253;	// "SRCP"
+	static constexpr uint32_t VERSION = 5;
+
+	CaptureWriter() = default;
+	~CaptureWriter();
+	CaptureWriter(const CaptureWriter&) = delete;
+	CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+	bool open(const char* path, int w, int h, PixelFormat format, int frames);
+
+	void recordDepthBuffer(DepthFormat format, bool tileCompression, SurfaceLayout layout);
+	void recordColorLayout(SurfaceLayout layout);
+	void recordClearColor(const float color[4]);
+	void recordOp(CaptureOp op);
+	void recordDraw(IShader* shader, const PipelineStateDesc& pipeline, const void* vertices, std::size_t vertexCount,
+		const uint32_t* indices, std::size_t indexCount);
+	void recordMeshletDraw(IShader* shader, const PipelineStateDesc& pipeline, const void* vertices, std::size_t vertexCount,
+		const MeshletMesh& mesh, const Eigen::Matrix4f& objectToClip);
+	// Returns true once the requested number of frames has been written and the file closed
+	bool endFrame();
+};
+
+// Re-executes a capture on a renderer of the recorded size, without the application that made it.
+// Shaders are code and are not captured: the host registers instances of the same classes.
+class CaptureReplayer
+{
+	struct Command {
+		CaptureOp op;
+		std::size_t offset;	// payload in `data`
+	};
+
+	std::vector<uint8_t> data;
+	std::vector<Command> commands;
+	std::vector<std::size_t> bufferOffsets;
+	std::vector<std::size_t> bufferSizes;
+	std::unordered_map<std::string, IShader*> shaders;
+	// Meshlet meshes rebuilt from their tables, in the order of the DRAW_MESHLETS commands
+	std::vector<std::shared_ptr<const MeshletMesh>> meshletMeshes;
+
+	std::shared_ptr<const MeshletMesh> loadMeshletMesh(const uint32_t tables[5], std::size_t vertexCount) const;
+
+	int w = 0;
+	int h = 0;
+	PixelFormat format = PixelFormat::BGRA8888;
+
+public:
+	bool load(const char* path);
+	void registerShader(IShader* shader);
+
+	int getWidth() const noexcept { return w; }
+	int getHeight() const noexcept { return h; }
+	PixelFormat getPixelFormat() const noexcept { return format; }
+
+	// Replays every captured call, returning how long each frame took in milliseconds.
+	// Fails when the capture names a shader which was not registered.
+	bool replay(SoftwareRenderer& renderer, std::vector<double>& frameTimes, std::string& error);
+};
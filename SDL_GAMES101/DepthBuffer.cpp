@@ -0,0 +1,158 @@
+#include "DepthBuffer.h"
+#include <cassert>
+#include <cstring>
+
+DepthBuffer::DepthBuffer(int w, int h, DepthFormat format, bool tileCompression, SurfaceLayout layout):
+	w(w), h(h), format(format), tileCompression(tileCompression), layout(layout)
+{
+	assert(w > 0 && h > 0 && "Invalid depth buffer size!");
+
+	// Storage is padded to whole tiles, so expanding an edge tile never goes out of bounds
+	tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+	addressing = SurfaceAddressing(layout, w, std::size_t(tilesX) * TILE_SIZE, 1);
+
+	std::size_t bytesPerPixel = sizeof(uint32_t);
+	if (format == DepthFormat::UNORM16)
+		bytesPerPixel = sizeof(uint16_t);
+
+	const std::size_t bytes = SurfaceAddressing::tiledSize(w, h, bytesPerPixel);
+	storage.resize((bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+	tileStates.resize(std::size_t(tilesX) * tilesY, TileState::EXPANDED);
+	tilePlanes.resize(std::size_t(tilesX) * tilesY);
+
+	clear();
+}
+
+void DepthBuffer::clear() noexcept
+{
+	if (tileCompression) {
+		std::fill(tileStates.begin(), tileStates.end(), TileState::CLEARED);
+	}
+	else {
+		// the far plane is 0 in every format
+		std::fill(storage.begin(), storage.end(), 0);
+	}
+}
+
+void DepthBuffer::clearRect(int x0, int y0, int x1, int y1) noexcept
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, w);
+	y1 = std::min(y1, h);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	const std::size_t elementSize = format == DepthFormat::UNORM16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	uint8_t* bytes = reinterpret_cast<uint8_t*>(storage.data());
+
+	// Spans are contiguous up to the end of the row, or of the tile in tiled layout
+	auto fillZero = [&](int fx0, int fy0, int fx1, int fy1) {
+		for (int y = fy0; y < fy1; ++y) {
+			const std::size_t row = addressing.row(y);
+			for (int x = fx0; x < fx1;) {
+				const int end = layout == SurfaceLayout::TILED ? std::min(fx1, (x | (TILE_SIZE - 1)) + 1) : fx1;
+				std::memset(bytes + (row + addressing.column(x)) * elementSize, 0, std::size_t(end - x) * elementSize);
+				x = end;
+			}
+		}
+	};
+
+	if (!tileCompression) {
+		fillZero(x0, y0, x1, y1);
+		return;
+	}
+
+	for (int ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ++ty) {
+		for (int tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; ++tx) {
+			const int tileX0 = tx * TILE_SIZE;
+			const int tileY0 = ty * TILE_SIZE;
+			const int tileX1 = std::min(tileX0 + TILE_SIZE, w);
+			const int tileY1 = std::min(tileY0 + TILE_SIZE, h);
+
+			if (tileX0 >= x0 && tileY0 >= y0 && tileX1 <= x1 && tileY1 <= y1) {
+				tileStates[std::size_t(ty) * tilesX + tx] = TileState::CLEARED;
+			}
+			else {
+				expandTile(tx, ty);
+				fillZero(std::max(tileX0, x0), std::max(tileY0, y0), std::min(tileX1, x1), std::min(tileY1, y1));
+			}
+		}
+	}
+}
+
+template <DepthFormat F>
+void DepthBuffer::expandTile(int tx, int ty) noexcept
+{
+	using Traits = DepthTraits<F>;
+
+	const std::size_t tile = std::size_t(ty) * tilesX + tx;
+	const TileState state = tileStates[tile];
+	if (state == TileState::EXPANDED)
+		return;
+
+	const Plane& plane = tilePlanes[tile];
+	auto target = data<F>();
+
+	for (int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; ++y) {
+		auto row = target + addressing.row(y);
+		for (int x = tx * TILE_SIZE; x < (tx + 1) * TILE_SIZE; ++x) {
+			row[addressing.column(x)] = state == TileState::PLANE ? Traits::encode(plane.at(x, y)) : Traits::encode(0.0f);
+		}
+	}
+
+	tileStates[tile] = TileState::EXPANDED;
+}
+
+void DepthBuffer::expandTile(int tx, int ty) noexcept
+{
+	switch (format) {
+	case DepthFormat::FLOAT32: expandTile<DepthFormat::FLOAT32>(tx, ty); break;
+	case DepthFormat::UNORM24: expandTile<DepthFormat::UNORM24>(tx, ty); break;
+	case DepthFormat::UNORM16: expandTile<DepthFormat::UNORM16>(tx, ty); break;
+	}
+}
+
+template <DepthFormat F>
+static float readDepth(const void* storage, std::size_t offset) noexcept
+{
+	using Traits = DepthTraits<F>;
+	return Traits::decode(reinterpret_cast<const typename Traits::Type*>(storage)[offset]);
+}
+
+float DepthBuffer::getDepth(int x, int y) const noexcept
+{
+	assert(x >= 0 && x < w && y >= 0 && y < h && "Depth buffer out of range!");
+
+	const std::size_t tile = std::size_t(y / TILE_SIZE) * tilesX + x / TILE_SIZE;
+	const float planeDepth = tilePlanes[tile].at(x, y);
+
+	switch (tileStates[tile]) {
+	case TileState::CLEARED:
+		return 0.0f;
+	case TileState::PLANE:
+		switch (format) {
+		case DepthFormat::FLOAT32: return planeDepth;
+		case DepthFormat::UNORM24: return DepthTraits<DepthFormat::UNORM24>::decode(DepthTraits<DepthFormat::UNORM24>::encode(planeDepth));
+		case DepthFormat::UNORM16: return DepthTraits<DepthFormat::UNORM16>::decode(DepthTraits<DepthFormat::UNORM16>::encode(planeDepth));
+		}
+		break;
+	case TileState::EXPANDED:
+		break;
+	}
+
+	const std::size_t offset = addressing.row(y) + addressing.column(x);
+	switch (format) {
+	case DepthFormat::FLOAT32: return readDepth<DepthFormat::FLOAT32>(storage.data(), offset);
+	case DepthFormat::UNORM24: return readDepth<DepthFormat::UNORM24>(storage.data(), offset);
+	case DepthFormat::UNORM16: return readDepth<DepthFormat::UNORM16>(storage.data(), offset);
+	}
+	return 0.0f;
+}
+
+DepthBuffer::TileState DepthBuffer::getTileState(int tx, int ty) const noexcept
+{
+	return tileStates[std::size_t(ty) * tilesX + tx];
+}
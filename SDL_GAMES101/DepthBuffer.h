@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include "PixelFormat.h"
+
+// Depth is stored reversed: 1 at the near plane and 0 at the far plane,
+// a fragment passes when it is greater than the stored value.
+// The depth of a fragment is its z / w, unchanged, so projections must map the near plane to z = w
+// and the far plane to z = 0. FLOAT32 then keeps its densest values for the distance.
+enum class DepthFormat {
+	FLOAT32,
+	UNORM24,	// 24 bits in a 32-bit word, the upper 8 bits are unused
+	UNORM16,
+};
+
+enum class DepthFunc {
+	GREATER,	// nearer than the stored depth
+	EQUAL,		// exactly the stored depth, as written by a depth prepass of the same geometry.
+				// Surfaces quantized to the same UNORM16 value both pass.
+};
+
+template <DepthFormat F> struct DepthTraits;
+
+template <> struct DepthTraits<DepthFormat::FLOAT32> {
+	using Type = float;
+	static inline Type encode(float d) noexcept { return d; }
+	static inline float decode(Type v) noexcept { return v; }
+};
+
+template <> struct DepthTraits<DepthFormat::UNORM24> {
+	using Type = uint32_t;
+	static constexpr float scale = 16777215.0f;
+	static inline Type encode(float d) noexcept { return static_cast<Type>(std::min(std::max(d, 0.0f), 1.0f) * scale + 0.5f); }
+	static inline float decode(Type v) noexcept { return v / scale; }
+};
+
+template <> struct DepthTraits<DepthFormat::UNORM16> {
+	using Type = uint16_t;
+	static constexpr float scale = 65535.0f;
+	static inline Type encode(float d) noexcept { return static_cast<Type>(std::min(std::max(d, 0.0f), 1.0f) * scale + 0.5f); }
+	static inline float decode(Type v) noexcept { return v / scale; }
+};
+
+class DepthBuffer
+{
+	friend class Rasterizer;
+public:
+	static constexpr int TILE_SIZE = 8;
+	static_assert(TILE_SIZE == SurfaceAddressing::TILE_SIZE, "Depth tiles are the tiles of the tiled layout");
+
+	enum class TileState : uint8_t {
+		CLEARED,	// every pixel holds the clear value, storage is stale
+		PLANE,		// covered by a single triangle, depth comes from its plane equation
+		EXPANDED,	// per-pixel values live in storage
+	};
+
+	// Depth of a triangle over the screen, evaluated at pixel centers
+	struct Plane {
+		float a, b, c;
+
+		float at(int x, int y) const noexcept {
+			return a * (x + 0.5f) + (b * (y + 0.5f) + c);
+		}
+	};
+
+private:
+	int w;
+	int h;
+	int tilesX;
+	int tilesY;
+	DepthFormat format;
+	bool tileCompression;
+	SurfaceLayout layout;
+	// In elements of the depth format
+	SurfaceAddressing addressing;
+
+	std::vector<uint32_t> storage;
+	std::vector<TileState> tileStates;
+	std::vector<Plane> tilePlanes;
+
+	template <DepthFormat F>
+	typename DepthTraits<F>::Type* data() noexcept {
+		return reinterpret_cast<typename DepthTraits<F>::Type*>(storage.data());
+	}
+
+	template <DepthFormat F>
+	void expandTile(int tx, int ty) noexcept;
+	void expandTile(int tx, int ty) noexcept;
+
+	// Store a fully covered tile as `plane` if it passes the depth test on every pixel
+	template <DepthFormat F>
+	bool acceptPlane(int tx, int ty, const Plane& plane) noexcept;
+
+	// Whether the tile is stored as exactly this plane
+	bool matchesPlane(int tx, int ty, const Plane& plane) const noexcept {
+		const std::size_t tile = std::size_t(ty) * tilesX + tx;
+		const Plane& stored = tilePlanes[tile];
+		return tileStates[tile] == TileState::PLANE && stored.a == plane.a && stored.b == plane.b && stored.c == plane.c;
+	}
+
+public:
+	DepthBuffer(int w, int h, DepthFormat format = DepthFormat::FLOAT32, bool tileCompression = false,
+		SurfaceLayout layout = SurfaceLayout::LINEAR);
+
+	int getWidth() const noexcept { return w; }
+	int getHeight() const noexcept { return h; }
+	DepthFormat getFormat() const noexcept { return format; }
+	bool isTileCompressionEnabled() const noexcept { return tileCompression; }
+	SurfaceLayout getLayout() const noexcept { return layout; }
+
+	void clear() noexcept;
+	// Clear the half-open rectangle [x0, x1) x [y0, y1)
+	void clearRect(int x0, int y0, int x1, int y1) noexcept;
+	float getDepth(int x, int y) const noexcept;
+	TileState getTileState(int tx, int ty) const noexcept;
+};
+
+template <DepthFormat F>
+bool DepthBuffer::acceptPlane(int tx, int ty, const Plane& plane) noexcept
+{
+	using Traits = DepthTraits<F>;
+
+	// Partial tiles on the right and top edges are always kept expanded
+	if ((tx + 1) * TILE_SIZE > w || (ty + 1) * TILE_SIZE > h)
+		return false;
+
+	const std::size_t tile = std::size_t(ty) * tilesX + tx;
+	const TileState state = tileStates[tile];
+	if (state == TileState::EXPANDED)
+		return false;
+
+	// Both depths are planar, so their extremes over the tile lie at its corners
+	typename Traits::Type minNew = Traits::encode(1.0f);
+	typename Traits::Type maxOld = Traits::encode(0.0f);
+
+	for (int corner = 0; corner < 4; ++corner) {
+		const int x = tx * TILE_SIZE + (corner & 1) * (TILE_SIZE - 1);
+		const int y = ty * TILE_SIZE + (corner >> 1) * (TILE_SIZE - 1);
+		minNew = std::min(minNew, Traits::encode(plane.at(x, y)));
+		if (state == TileState::PLANE)
+			maxOld = std::max(maxOld, Traits::encode(tilePlanes[tile].at(x, y)));
+	}
+
+	if (!(minNew > maxOld))
+		return false;
+
+	tileStates[tile] = TileState::PLANE;
+	tilePlanes[tile] = plane;
+	return true;
+}
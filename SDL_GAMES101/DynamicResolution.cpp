@@ -0,0 +1,82 @@
+#include "DynamicResolution.h"
+#include "SoftwareRenderer.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+DynamicResolution::DynamicResolution(SoftwareRenderer& renderer, const DynamicResolutionOptions& options):
+	renderer(renderer), options(options)
+{
+	assert(options.minScale > 0.0f && options.minScale <= options.maxScale && options.maxScale <= 1.0f && "Invalid scale range!");
+	assert(options.targetFrameMs > 0.0 && "Invalid frame time target!");
+
+	output = reinterpret_cast<uint8_t*>(renderer.getFrameBuffer());
+	outputW = renderer.getWidth();
+	outputH = renderer.getHeight();
+	outputPitch = renderer.getPitch();
+	format = renderer.getPixelFormat();
+
+	// Sized once for the largest scale, smaller targets use the same rows
+	const std::size_t bpp = PixelPacker::bytesPerPixel(format);
+	targetPitch = static_cast<int>(bpp * std::size_t(std::ceil(outputW * options.maxScale)));
+	target.resize(std::size_t(targetPitch) * std::size_t(std::ceil(outputH * options.maxScale)));
+
+	scale = appliedScale = 1.0f;
+	setScale(options.maxScale);
+}
+
+void DynamicResolution::setScale(float scale)
+{
+	this->scale = std::min(std::max(scale, options.minScale), options.maxScale);
+}
+
+void DynamicResolution::applyScale()
+{
+	if (scale == appliedScale)
+		return;
+
+	if (scale >= 1.0f) {
+		renderer.setRenderTarget(output, outputW, outputH, outputPitch);
+	}
+	else {
+		const int w = std::max(1, static_cast<int>(outputW * scale + 0.5f));
+		const int h = std::max(1, static_cast<int>(outputH * scale + 0.5f));
+		renderer.setRenderTarget(target.data(), w, h, targetPitch);
+	}
+
+	// Predicted for the new pixel count, so the history does not push the scale further
+	averageFrameMs *= (scale * scale) / (appliedScale * appliedScale);
+	appliedScale = scale;
+}
+
+void DynamicResolution::beginFrame()
+{
+	// The size of a capture is fixed when it starts
+	if (!renderer.isCapturing())
+		applyScale();
+
+	frameStart = Clock::now();
+}
+
+void DynamicResolution::present(bool redrawn)
+{
+	if (!redrawn)
+		return;
+
+	if (appliedScale < 1.0f) {
+		PixelPacker::scaleImage(target.data(), targetPitch, renderer.getWidth(), renderer.getHeight(),
+			output, outputPitch, outputW, outputH, format);
+	}
+
+	const double frameMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+	averageFrameMs = averageFrameMs > 0.0 ? averageFrameMs + (frameMs - averageFrameMs) * options.smoothing : frameMs;
+
+	// Drawing cost follows the pixel count, the square of the scale
+	const float ideal = appliedScale * static_cast<float>(std::sqrt(options.targetFrameMs / averageFrameMs));
+	const float stepped = std::floor(ideal / options.scaleStep) * options.scaleStep;
+
+	if (averageFrameMs > options.targetFrameMs)
+		setScale(std::min(stepped, appliedScale - options.scaleStep));
+	else if (averageFrameMs < options.targetFrameMs * options.headroom && stepped > appliedScale)
+		setScale(stepped);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <vector>
+#include "PixelFormat.h"
+
+class SoftwareRenderer;
+
+struct DynamicResolutionOptions {
+	double targetFrameMs = 1000.0 / 60;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	// Scales are multiples of this step, so small variations in frame time do not resize the target
+	float scaleStep = 0.05f;
+	// Resolution only grows back while frames take less than this fraction of the target
+	float headroom = 0.8f;
+	// Weight of the newest frame in the averaged frame time
+	float smoothing = 0.2f;
+};
+
+// Renders through a scaled down internal target which is upscaled to the output surface,
+// with the scale adjusted after every redrawn frame to hold a frame time budget.
+// The output is the target the renderer was bound to when this was created.
+class DynamicResolution
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+private:
+	SoftwareRenderer& renderer;
+	DynamicResolutionOptions options;
+
+	uint8_t* output;
+	int outputW;
+	int outputH;
+	int outputPitch;
+	PixelFormat format;
+
+	std::vector<uint8_t> target;
+	int targetPitch;
+
+	float scale;
+	float appliedScale;
+	double averageFrameMs = 0.0;
+	Clock::time_point frameStart;
+
+	void applyScale();
+
+public:
+	DynamicResolution(SoftwareRenderer& renderer, const DynamicResolutionOptions& options = DynamicResolutionOptions());
+
+	// Around the frame drawn by the renderer. A frame which was not redrawn is not upscaled
+	// and does not count towards the frame time, as it says nothing about the cost of drawing.
+	void beginFrame();
+	void present(bool redrawn = true);
+
+	float getScale() const noexcept { return appliedScale; }
+	double getAverageFrameMs() const noexcept { return averageFrameMs; }
+	// Jumps to a scale, e.g. when the scene changed too much for the frame time history to apply
+	void setScale(float scale);
+};
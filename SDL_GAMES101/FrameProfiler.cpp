@@ -0,0 +1,158 @@
+#include "FrameProfiler.h"
+#include <cassert>
+#include <cstdio>
+#include <algorithm>
+
+FrameProfiler::FrameProfiler(int w, int h): w(w), h(h)
+{
+	assert(w > 0 && h > 0 && "Invalid profiler size!");
+
+	tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+	tileTimes.resize(std::size_t(tilesX) * tilesY, 0.0);
+	tileFragments.resize(std::size_t(tilesX) * tilesY, 0);
+	rowFragments.resize(tilesX, 0);
+	rowTileBegin = tilesX;
+	rowTileEnd = 0;
+}
+
+void FrameProfiler::beginCapture()
+{
+	assert(!capturing && "Capture already began!");
+	capturing = true;
+	captureStart = Clock::now();
+	events.clear();
+	std::fill(tileTimes.begin(), tileTimes.end(), 0.0);
+	std::fill(tileFragments.begin(), tileFragments.end(), 0);
+}
+
+void FrameProfiler::endCapture()
+{
+	assert(capturing && "No capture to end!");
+	capturing = false;
+}
+
+std::size_t FrameProfiler::beginEvent(const char* name, const char* category)
+{
+	events.push_back({ name, category, Clock::now(), Clock::duration::zero(), {} });
+	return events.size() - 1;
+}
+
+void FrameProfiler::endEvent(std::size_t event)
+{
+	events[event].duration = Clock::now() - events[event].start;
+}
+
+void FrameProfiler::addEventArg(std::size_t event, const char* key, double value)
+{
+	events[event].args.emplace_back(key, value);
+}
+
+void FrameProfiler::endRow(int y, Clock::time_point rowStart) noexcept
+{
+	if (rowTileBegin >= rowTileEnd)
+		return;
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - rowStart).count();
+
+	uint32_t total = 0;
+	for (int tx = rowTileBegin; tx < rowTileEnd; ++tx)
+		total += rowFragments[tx];
+
+	const std::size_t rowOffset = std::size_t(y / TILE_SIZE) * tilesX;
+	for (int tx = rowTileBegin; tx < rowTileEnd; ++tx) {
+		tileTimes[rowOffset + tx] += seconds * rowFragments[tx] / total;
+		tileFragments[rowOffset + tx] += rowFragments[tx];
+		rowFragments[tx] = 0;
+	}
+
+	rowTileBegin = tilesX;
+	rowTileEnd = 0;
+}
+
+FrameProfiler::Scope::Scope(FrameProfiler* profiler, const char* name, const char* category):
+	profiler(profiler && profiler->isCapturing() ? profiler : nullptr), event(0)
+{
+	if (this->profiler)
+		event = this->profiler->beginEvent(name, category);
+}
+
+FrameProfiler::Scope::~Scope()
+{
+	if (profiler)
+		profiler->endEvent(event);
+}
+
+void FrameProfiler::Scope::addArg(const char* key, double value)
+{
+	if (profiler)
+		profiler->addEventArg(event, key, value);
+}
+
+bool FrameProfiler::writeTrace(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	auto micros = [](Clock::duration d) {
+		return std::chrono::duration<double, std::micro>(d).count();
+	};
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (std::size_t i = 0; i < events.size(); ++i) {
+		const Event& event = events[i];
+		fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+			event.name, event.category, micros(event.start - captureStart), micros(event.duration));
+		for (std::size_t j = 0; j < event.args.size(); ++j)
+			fprintf(file, "%s\"%s\":%.6g", j ? "," : "", event.args[j].first, event.args[j].second);
+		fprintf(file, "}}%s\n", i + 1 < events.size() ? "," : "");
+	}
+	fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	return fclose(file) == 0;
+}
+
+bool FrameProfiler::writeHeatmap(const char* path, HeatmapMetric metric) const
+{
+	auto tileValue = [&](std::size_t tile) {
+		return metric == HeatmapMetric::SHADING_TIME ? tileTimes[tile] : double(tileFragments[tile]);
+	};
+
+	// White at the 95th percentile of the touched tiles, so a few preempted rows do not hide the rest
+	std::vector<double> values;
+	for (std::size_t tile = 0; tile < tileTimes.size(); ++tile) {
+		if (tileValue(tile) > 0.0)
+			values.push_back(tileValue(tile));
+	}
+
+	double maxValue = 0.0;
+	if (!values.empty()) {
+		auto percentile = values.begin() + (values.size() - 1) * 95 / 100;
+		std::nth_element(values.begin(), percentile, values.end());
+		maxValue = *percentile;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", w, h);
+
+	std::vector<uint8_t> row(std::size_t(w) * 3);
+	// Tile rows count upwards like the rasterizer, image rows go down
+	for (int y = h - 1; y >= 0; --y) {
+		for (int x = 0; x < w; ++x) {
+			const double value = tileValue(std::size_t(y / TILE_SIZE) * tilesX + x / TILE_SIZE);
+			const double t = maxValue > 0.0 ? std::min(value / maxValue, 1.0) : 0.0;
+
+			// black -> red -> yellow -> white
+			row[3 * x + 0] = static_cast<uint8_t>(std::min(t * 3.0, 1.0) * 255);
+			row[3 * x + 1] = static_cast<uint8_t>(std::min(std::max(t * 3.0 - 1.0, 0.0), 1.0) * 255);
+			row[3 * x + 2] = static_cast<uint8_t>(std::min(std::max(t * 3.0 - 2.0, 0.0), 1.0) * 255);
+		}
+		fwrite(row.data(), 1, row.size(), file);
+	}
+
+	return fclose(file) == 0;
+}
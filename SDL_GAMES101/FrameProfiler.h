@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+// Records the timeline and the per-tile cost of captured frames. Renderers only
+// pay for the instrumentation between beginCapture() and endCapture().
+class FrameProfiler
+{
+	friend class Rasterizer;
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr int TILE_SIZE = 16;
+
+	enum class HeatmapMetric {
+		SHADING_TIME,
+		FRAGMENTS,
+	};
+
+	struct Event {
+		const char* name;
+		const char* category;
+		Clock::time_point start;
+		Clock::duration duration;
+		std::vector<std::pair<const char*, double>> args;
+	};
+
+	// Records an event spanning its lifetime, when a capture is running
+	class Scope {
+		FrameProfiler* profiler;
+		std::size_t event;
+	public:
+		Scope(FrameProfiler* profiler, const char* name, const char* category);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		void addArg(const char* key, double value);
+	};
+
+private:
+	int w;
+	int h;
+	int tilesX;
+	int tilesY;
+	bool capturing = false;
+
+	Clock::time_point captureStart;
+	std::vector<Event> events;
+	std::vector<double> tileTimes;
+	std::vector<uint64_t> tileFragments;
+
+	// Fragments shaded per tile on the scanline being rasterized
+	std::vector<uint32_t> rowFragments;
+	int rowTileBegin;
+	int rowTileEnd;
+
+	void countFragment(int x) noexcept {
+		const int tile = x / TILE_SIZE;
+		rowFragments[tile]++;
+		rowTileBegin = rowTileBegin < tile ? rowTileBegin : tile;
+		rowTileEnd = rowTileEnd > tile + 1 ? rowTileEnd : tile + 1;
+	}
+	// Spread the time of a scanline over its tiles by their fragment counts
+	void endRow(int y, Clock::time_point rowStart) noexcept;
+
+public:
+	FrameProfiler(int w, int h);
+
+	int getWidth() const noexcept { return w; }
+	int getHeight() const noexcept { return h; }
+
+	// Starting a capture drops everything recorded by the previous one
+	void beginCapture();
+	void endCapture();
+	bool isCapturing() const noexcept { return capturing; }
+
+	std::size_t beginEvent(const char* name, const char* category);
+	void endEvent(std::size_t event);
+	void addEventArg(std::size_t event, const char* key, double value);
+
+	const std::vector<Event>& getEvents() const noexcept { return events; }
+	double getTileTime(int tx, int ty) const noexcept { return tileTimes[std::size_t(ty) * tilesX + tx]; }
+	uint64_t getTileFragments(int tx, int ty) const noexcept { return tileFragments[std::size_t(ty) * tilesX + tx]; }
+
+	// Chrome trace event JSON, loadable in chrome://tracing or Perfetto
+	bool writeTrace(const char* path) const;
+	// Binary PPM of the surface size, tiles colored from black to white by cost
+	bool writeHeatmap(const char* path, HeatmapMetric metric) const;
+};
@@ -0,0 +1,157 @@
+#include "FrameStream.h"
+#include <cassert>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+FrameStream::~FrameStream()
+{
+	close();
+}
+
+bool FrameStream::open(const char* path, int w, int h, PixelFormat format, const FrameStreamOptions& options)
+{
+	assert(!file && "Stream already open!");
+	assert(w > 0 && h > 0 && options.bufferCount > 0 && options.frameRate > 0 && "Invalid stream!");
+	assert((options.format == FrameStreamFormat::RAW || format == PixelFormat::BGRA8888 || format == PixelFormat::RGBA32F)
+		&& "Y4M streams need BGRA8888 or RGBA32F frames!");
+
+	if (std::strcmp(path, "-") == 0) {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		file = stdout;
+		ownsFile = false;
+	}
+	else {
+		file = fopen(path, "wb");
+		ownsFile = true;
+		if (!file)
+			return false;
+	}
+
+	this->w = w;
+	this->h = h;
+	this->sourceFormat = format;
+	this->format = format;
+	this->options = options;
+
+	if (options.format == FrameStreamFormat::Y4M) {
+		// Frames are stored as BGRA8888, and written as planes of packed rows
+		this->format = PixelFormat::BGRA8888;
+		const std::size_t chromaSize = std::size_t((w + 1) / 2) * ((h + 1) / 2);
+		output.resize(std::size_t(w) * h + 2 * chromaSize);
+
+		if (fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, options.frameRate) < 0) {
+			close();
+			return false;
+		}
+	}
+
+	const std::size_t frameSize = std::size_t(w) * h * PixelPacker::bytesPerPixel(this->format);
+	frames.resize(options.bufferCount);
+	for (auto& frame : frames)
+		frame.pixels.resize(frameSize);
+
+	head = count = framesWritten = 0;
+	closing = failed = false;
+	stallTime = {};
+	writer = std::thread(&FrameStream::writeFrames, this);
+	return true;
+}
+
+bool FrameStream::submit(const void* pixels, int pitch)
+{
+	assert(file && "Stream is not open!");
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (count == frames.size()) {
+		const auto start = std::chrono::steady_clock::now();
+		frameWritten.wait(lock, [this] { return count < frames.size() || failed; });
+		stallTime += std::chrono::steady_clock::now() - start;
+	}
+	if (failed)
+		return false;
+
+	// The writer does not touch frames past the ones submitted, so the copy happens unlocked
+	Frame& frame = frames[(head + count) % frames.size()];
+	lock.unlock();
+
+	const int bpp = static_cast<int>(PixelPacker::bytesPerPixel(format));
+	PixelPacker::convertImage(pixels, pitch, sourceFormat,
+		frame.pixels.data(), w * bpp, format, w, h);
+
+	lock.lock();
+	count++;
+	frameSubmitted.notify_one();
+	return true;
+}
+
+void FrameStream::writeFrames()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		frameSubmitted.wait(lock, [this] { return count > 0 || closing; });
+		if (count == 0)
+			return;
+
+		const Frame& frame = frames[head];
+		lock.unlock();
+		const bool written = !failed && writeFrame(frame);
+		lock.lock();
+
+		head = (head + 1) % frames.size();
+		count--;
+		if (written)
+			framesWritten++;
+		else
+			failed = true;
+		frameWritten.notify_one();
+	}
+}
+
+bool FrameStream::writeFrame(const Frame& frame)
+{
+	if (options.format == FrameStreamFormat::RAW)
+		return fwrite(frame.pixels.data(), 1, frame.pixels.size(), file) == frame.pixels.size();
+
+	const std::size_t lumaSize = std::size_t(w) * h;
+	const std::size_t chromaSize = std::size_t((w + 1) / 2) * ((h + 1) / 2);
+	PixelPacker::convertToI420(frame.pixels.data(), w * 4, w, h,
+		output.data(), output.data() + lumaSize, output.data() + lumaSize + chromaSize);
+
+	static const char header[] = "FRAME\n";
+	return fwrite(header, 1, sizeof(header) - 1, file) == sizeof(header) - 1 &&
+		fwrite(output.data(), 1, output.size(), file) == output.size();
+}
+
+bool FrameStream::close()
+{
+	if (!file)
+		return true;
+
+	if (writer.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		frameSubmitted.notify_one();
+		writer.join();
+	}
+
+	bool ok = !failed && fflush(file) == 0;
+	if (ownsFile)
+		ok = fclose(file) == 0 && ok;
+	file = nullptr;
+	return ok;
+}
+
+std::size_t FrameStream::getFramesWritten()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return framesWritten;
+}
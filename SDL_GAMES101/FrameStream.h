@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "PixelFormat.h"
+
+enum class FrameStreamFormat {
+	RAW,	// frames one after another in the pixel format of the source, rows packed
+	Y4M,	// YUV4MPEG2 with 4:2:0 chroma, read by most encoders and players
+};
+
+struct FrameStreamOptions {
+	FrameStreamFormat format = FrameStreamFormat::Y4M;
+	int frameRate = 60;
+	// Frames which may wait for the writer, submit() blocks when all of them do
+	int bufferCount = 4;
+};
+
+// Streams rendered frames to a file or a pipe without a display. submit() copies the frame into
+// one of a fixed set of buffers and returns; a writer thread converts and writes it meanwhile.
+class FrameStream
+{
+	struct Frame {
+		std::vector<uint8_t> pixels;
+	};
+
+	FILE* file = nullptr;
+	bool ownsFile = false;
+	int w = 0;
+	int h = 0;
+	// Format of the submitted frames, and the one they are kept in until written
+	PixelFormat sourceFormat = PixelFormat::BGRA8888;
+	PixelFormat format = PixelFormat::BGRA8888;
+	FrameStreamOptions options;
+
+	// Ring of frames: `count` submitted ones from `head` wait for the writer
+	std::vector<Frame> frames;
+	std::size_t head = 0;
+	std::size_t count = 0;
+	bool closing = false;
+	bool failed = false;
+	std::size_t framesWritten = 0;
+	std::mutex mutex;
+	std::condition_variable frameSubmitted;
+	std::condition_variable frameWritten;
+	std::thread writer;
+
+	// Used by the writer thread only
+	std::vector<uint8_t> output;
+
+	// Time submit() spent waiting for a free buffer, i.e. rendering was limited by the output
+	std::chrono::steady_clock::duration stallTime{};
+
+	void writeFrames();
+	bool writeFrame(const Frame& frame);
+
+public:
+	FrameStream() = default;
+	~FrameStream();
+	FrameStream(const FrameStream&) = delete;
+	FrameStream& operator=(const FrameStream&) = delete;
+
+	// `path` "-" streams to the standard output, e.g. piped into an encoder.
+	// Y4M needs BGRA8888 frames, or RGBA32F ones which are converted to it first.
+	bool open(const char* path, int w, int h, PixelFormat format, const FrameStreamOptions& options = FrameStreamOptions());
+	bool isOpen() const noexcept { return file != nullptr; }
+
+	// Fails once a write failed, the stream is then closed by close()
+	bool submit(const void* pixels, int pitch);
+	// Waits for the submitted frames to be written, returning false if any write failed
+	bool close();
+
+	std::size_t getFramesWritten();
+	std::chrono::steady_clock::duration getStallTime() const noexcept { return stallTime; }
+};
@@ -0,0 +1,65 @@
+#include "Frustum.h"
+
+Aabb Aabb::transformed(const Eigen::Matrix4f& transform) const noexcept
+{
+	if (isEmpty())
+		return *this;
+
+	// Each output extent sums the extremes of the rotated axes
+	const Eigen::Matrix3f linear = transform.block<3, 3>(0, 0);
+	const Eigen::Vector3f center = linear * this->center() + transform.block<3, 1>(0, 3);
+	const Eigen::Vector3f extent = linear.cwiseAbs() * ((upper - lower) / 2);
+	return { center - extent, center + extent };
+}
+
+Frustum::Frustum(const Eigen::Matrix4f& viewProjection)
+{
+	const Eigen::Matrix4f& m = viewProjection;
+
+	// A point is inside when -|w| <= x, y <= |w| and 0 <= z / w <= 1, giving the rows w + x, w - x, ..., z, w - z
+	for (int axis = 0; axis < 2; ++axis) {
+		planes[2 * axis] = (m.row(3) + m.row(axis)).transpose();
+		planes[2 * axis + 1] = (m.row(3) - m.row(axis)).transpose();
+	}
+	planes[4] = m.row(2).transpose();
+	planes[5] = (m.row(3) - m.row(2)).transpose();
+
+	// Those planes face inwards only where w is positive. The projection used by the demo gives negative w
+	// in front of the camera, so every plane is oriented to face the center of the view volume.
+	const Eigen::Vector4f center = m.inverse() * Eigen::Vector4f(0.0f, 0.0f, 0.5f, 1.0f);
+	const Eigen::Vector4f centerPoint(center.x() / center.w(), center.y() / center.w(), center.z() / center.w(), 1.0f);
+
+	for (auto& plane : planes) {
+		if (plane.dot(centerPoint) < 0.0f)
+			plane = -plane;
+		plane /= plane.head<3>().norm();
+	}
+}
+
+Frustum::Result Frustum::test(const Aabb& box) const noexcept
+{
+	const Eigen::Vector3f center = box.center();
+	const Eigen::Vector3f extent = (box.upper - box.lower) / 2;
+	Result result = Result::INSIDE;
+
+	for (const auto& plane : planes) {
+		const float distance = plane.head<3>().dot(center) + plane.w();
+		// Half the projection of the box on the plane normal
+		const float radius = plane.head<3>().cwiseAbs().dot(extent);
+
+		if (distance < -radius)
+			return Result::OUTSIDE;
+		if (distance < radius)
+			result = Result::INTERSECTS;
+	}
+	return result;
+}
+
+bool Frustum::intersectsSphere(const Eigen::Vector3f& center, float radius) const noexcept
+{
+	for (const auto& plane : planes) {
+		if (plane.head<3>().dot(center) + plane.w() < -radius)
+			return false;
+	}
+	return true;
+}
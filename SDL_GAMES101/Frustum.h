@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cfloat>
+#include <eigen3/Eigen/Eigen>
+
+struct Aabb {
+	Eigen::Vector3f lower;
+	Eigen::Vector3f upper;
+
+	static Aabb empty() noexcept {
+		return { Eigen::Vector3f::Constant(FLT_MAX), Eigen::Vector3f::Constant(-FLT_MAX) };
+	}
+
+	bool isEmpty() const noexcept { return !(lower.array() <= upper.array()).all(); }
+	Eigen::Vector3f center() const noexcept { return (lower + upper) / 2; }
+	float surfaceArea() const noexcept {
+		if (isEmpty())
+			return 0.0f;
+		const Eigen::Vector3f e = upper - lower;
+		return 2 * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
+	}
+	Aabb united(const Aabb& b) const noexcept { return { lower.cwiseMin(b.lower), upper.cwiseMax(b.upper) }; }
+	bool operator==(const Aabb& b) const noexcept { return lower == b.lower && upper == b.upper; }
+	bool operator!=(const Aabb& b) const noexcept { return !(*this == b); }
+
+	// Bounds of this box moved by an affine transform
+	Aabb transformed(const Eigen::Matrix4f& transform) const noexcept;
+};
+
+// Six planes of a view volume, with positive distances inside
+class Frustum
+{
+	Eigen::Vector4f planes[6];
+
+public:
+	enum class Result {
+		OUTSIDE,
+		INTERSECTS,
+		INSIDE,
+	};
+
+	// From the matrix taking world positions to clip space, e.g. projection * view.
+	// Works whichever sign w takes in front of the camera.
+	explicit Frustum(const Eigen::Matrix4f& viewProjection);
+
+	const Eigen::Vector4f& getPlane(int i) const noexcept { return planes[i]; }
+
+	Result test(const Aabb& box) const noexcept;
+	bool intersects(const Aabb& box) const noexcept { return test(box) != Result::OUTSIDE; }
+	bool intersectsSphere(const Eigen::Vector3f& center, float radius) const noexcept;
+};
@@ -2,6 +2,8 @@
 
 #include <eigen3/Eigen/Eigen>
 #include <memory>
+#include <vector>
+#include "VertexLayout.h"
 
 struct RenderContext;
 
@@ -9,17 +11,47 @@ class IShader
 {
 public:
 
+	// How a vertex output channel reaches the fragment shader
+	enum class Interpolation : uint8_t {
+		SMOOTH,			// perspective correct when the pipeline enables it, in screen space otherwise
+		NOPERSPECTIVE,	// always in screen space
+		FLAT,			// value of the first vertex of the triangle
+		UNUSED,			// not read by the fragment shader, left undefined
+	};
+
 	struct ShaderDescriptor {
 		std::size_t inputVertexSize;
 		std::size_t positionPlacement;
+		// Shaders calling RenderContext::discard must set this, it disables depth tile compression
+		bool usesDiscard = false;
+		// Compressed vertices: inputVertexSize is the stride of the layout, and the
+		// vertex shader receives each vertex decoded to floats
+		const VertexLayout* inputLayout = nullptr;
+		// One qualifier per vertex output channel, empty to interpolate every channel as before.
+		// Only the SMOOTH and NOPERSPECTIVE channels are interpolated per pixel. The position
+		// channels, when not UNUSED, hold (x/w, y/w, z/w, 1/w) interpolated in screen space.
+		std::vector<Interpolation> varyings;
 
 		Eigen::Vector4f extractPosition(const Eigen::VectorXf& vertShaderOut) const noexcept {
 			return vertShaderOut.segment<4>(positionPlacement);
 		};
 	};
 
+	// Uniform state read by the shader, as a block of plain bytes
+	struct ConstantBlock {
+		const void* data = nullptr;
+		std::size_t size = 0;
+	};
+
 	virtual const ShaderDescriptor& getDesc() noexcept = 0;
 	virtual void vertexShader(const RenderContext &ctx, const void *inputDatas, Eigen::VectorXf &vertexOut) noexcept = 0;
 	virtual void fragmentShader(const RenderContext &ctx, const Eigen::VectorXf &inputData, Eigen::Vector4f &colorOut) noexcept = 0;
+
+	// Used by frame recording, which restores the constants of every draw when replaying it.
+	// A shader without constants returns a non-null block of size 0. A null block leaves its
+	// draws redrawn every frame with the constants the shader holds when the frame ends. The
+	// bytes given back to setConstants() are a copy which may not be aligned for the shader's own types.
+	virtual ConstantBlock getConstants() noexcept { return {}; }
+	virtual void setConstants(const void* /*data*/, std::size_t /*size*/) noexcept {}
 };
 
@@ -0,0 +1,172 @@
+#include "MeshLod.h"
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <array>
+
+static inline Eigen::Vector3f readPosition(const void* vertices, std::size_t stride, std::size_t offset, std::size_t i) {
+	return Eigen::Vector3f::Map(reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(vertices) + i * stride + offset));
+}
+
+// Merge the vertices sharing a grid cell into the one closest to their centroid
+static void clusterVertices(const std::vector<Eigen::Vector3f>& positions, const Eigen::Vector3f& origin, float cellSize,
+	std::vector<uint32_t>& remap, float& error)
+{
+	struct Cluster {
+		Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+		uint32_t count = 0;
+		uint32_t representative = 0;
+		float distance = std::numeric_limits<float>::max();
+	};
+
+	std::unordered_map<uint64_t, uint32_t> cellClusters;
+	std::vector<Cluster> clusters;
+	std::vector<uint32_t> vertexClusters(positions.size());
+
+	for (std::size_t i = 0; i < positions.size(); ++i) {
+		const Eigen::Vector3f cell = ((positions[i] - origin) / cellSize).array().floor();
+		const uint64_t key = (uint64_t(uint32_t(cell.x())) & 0x1FFFFF) |
+			(uint64_t(uint32_t(cell.y()) & 0x1FFFFF) << 21) |
+			(uint64_t(uint32_t(cell.z()) & 0x1FFFFF) << 42);
+
+		auto inserted = cellClusters.emplace(key, static_cast<uint32_t>(clusters.size()));
+		if (inserted.second)
+			clusters.emplace_back();
+
+		Cluster& cluster = clusters[inserted.first->second];
+		cluster.sum += positions[i];
+		cluster.count++;
+		vertexClusters[i] = inserted.first->second;
+	}
+
+	for (std::size_t i = 0; i < positions.size(); ++i) {
+		Cluster& cluster = clusters[vertexClusters[i]];
+		const float distance = (positions[i] - cluster.sum / float(cluster.count)).squaredNorm();
+		if (distance < cluster.distance) {
+			cluster.distance = distance;
+			cluster.representative = static_cast<uint32_t>(i);
+		}
+	}
+
+	error = 0.0f;
+	remap.resize(positions.size());
+	for (std::size_t i = 0; i < positions.size(); ++i) {
+		remap[i] = clusters[vertexClusters[i]].representative;
+		error = std::max(error, (positions[i] - positions[remap[i]]).norm());
+	}
+}
+
+using Triangle = std::array<uint32_t, 3>;
+
+struct TriangleHash {
+	std::size_t operator()(const Triangle& tri) const noexcept {
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (uint32_t index : tri)
+			hash = (hash ^ index) * 0x100000001B3ull;
+		return static_cast<std::size_t>(hash);
+	}
+};
+
+// Remap the triangles and drop the ones which collapsed or became duplicates
+static std::vector<uint32_t> remapTriangles(const uint32_t* indices, std::size_t indexCount, const std::vector<uint32_t>& remap)
+{
+	std::vector<uint32_t> result;
+	std::unordered_set<Triangle, TriangleHash> seen;
+
+	for (std::size_t i = 0; i + 2 < indexCount; i += 3) {
+		Triangle tri = { remap[indices[i]], remap[indices[i + 1]], remap[indices[i + 2]] };
+		if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0])
+			continue;
+
+		// Rotate the smallest index first, which keeps the winding
+		while (tri[0] > tri[1] || tri[0] > tri[2])
+			std::rotate(tri.begin(), tri.begin() + 1, tri.end());
+
+		if (!seen.insert(tri).second)
+			continue;
+
+		result.insert(result.end(), tri.begin(), tri.end());
+	}
+	return result;
+}
+
+MeshLod::MeshLod(const void* vertices, std::size_t stride, std::size_t positionOffset, std::size_t vertexCount,
+	const uint32_t* indices, std::size_t indexCount, const MeshLodOptions& options): options(options)
+{
+	assert(vertexCount > 0 && indexCount % 3 == 0 && "Invalid mesh!");
+
+	std::vector<Eigen::Vector3f> positions(vertexCount);
+	Eigen::Vector3f lower = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+	Eigen::Vector3f upper = -lower;
+	for (std::size_t i = 0; i < vertexCount; ++i) {
+		positions[i] = readPosition(vertices, stride, positionOffset, i);
+		lower = lower.cwiseMin(positions[i]);
+		upper = upper.cwiseMax(positions[i]);
+	}
+
+	center = (lower + upper) / 2;
+	radius = 0.0f;
+	for (const auto& p : positions)
+		radius = std::max(radius, (p - center).norm());
+
+	levels.push_back({ std::vector<uint32_t>(indices, indices + indexCount), 0.0f });
+
+	// Clustering starts around the average edge length and grows until enough triangles go away
+	double edgeSum = 0.0;
+	for (std::size_t i = 0; i < indexCount; ++i)
+		edgeSum += (positions[indices[i]] - positions[indices[i - i % 3 + (i + 1) % 3]]).norm();
+	float cellSize = indexCount > 0 ? float(edgeSum / indexCount) : radius;
+
+	const float maxCellSize = 2 * radius;
+	while (int(levels.size()) < options.maxLevels && cellSize > 0.0f && cellSize <= maxCellSize) {
+		const Level& previous = levels.back();
+		if (previous.indices.size() / 3 <= options.minTriangles)
+			break;
+
+		std::vector<uint32_t> remap;
+		float error;
+		clusterVertices(positions, lower, cellSize, remap, error);
+		auto simplified = remapTriangles(indices, indexCount, remap);
+		cellSize *= 1.5f;
+
+		if (simplified.empty() || simplified.size() > previous.indices.size() * options.minReduction)
+			continue;
+
+		levels.push_back({ std::move(simplified), std::max(error, previous.error) });
+	}
+}
+
+float MeshLod::projectedRadius(const Eigen::Matrix4f& mvp, int viewportWidth, int viewportHeight) const noexcept
+{
+	const float w = mvp.row(3).head<3>().dot(center) + mvp(3, 3);
+	// Growth of w over the sphere, zero for orthographic projections
+	const float wRadius = radius * mvp.row(3).head<3>().norm();
+	if (std::fabs(w) <= wRadius)
+		return std::numeric_limits<float>::infinity();
+
+	const float scale = std::max(mvp.row(0).head<3>().norm() * viewportWidth, mvp.row(1).head<3>().norm() * viewportHeight) / 2;
+	return radius * scale / std::sqrt(w * w - wRadius * wRadius);
+}
+
+int MeshLod::selectLevel(float projectedRadius, int currentLevel) const noexcept
+{
+	if (!std::isfinite(projectedRadius) || radius <= 0.0f)
+		return 0;
+
+	auto coarsestWithin = [&](float pixels) {
+		int level = 0;
+		while (level + 1 < getLevelCount() && levels[level + 1].error / radius * projectedRadius <= pixels)
+			level++;
+		return level;
+	};
+
+	currentLevel = std::min(std::max(currentLevel, 0), getLevelCount() - 1);
+	const int target = coarsestWithin(options.pixelError);
+	if (target <= currentLevel)
+		return target;
+
+	return std::max(currentLevel, coarsestWithin(options.pixelError * (1.0f - options.hysteresis)));
+}
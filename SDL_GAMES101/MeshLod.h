@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+struct MeshLodOptions {
+	int maxLevels = 6;
+	// A level is kept only if it has at most this fraction of the triangles of the previous one
+	float minReduction = 0.7f;
+	std::size_t minTriangles = 8;
+	// Largest error on screen, in pixels, accepted when selecting a level
+	float pixelError = 2.0f;
+	// Switching to a coarser level needs the error to drop this fraction below pixelError
+	float hysteresis = 0.25f;
+};
+
+// Chain of progressively simplified index buffers over one vertex array.
+// Coarser levels are built by vertex clustering, so every level indexes the
+// original vertices and the vertex array is bound once for all of them.
+class MeshLod
+{
+public:
+	struct Level {
+		std::vector<uint32_t> indices;
+		// Largest distance a vertex was moved by the simplification, in object space
+		float error;
+	};
+
+private:
+	std::vector<Level> levels;
+	Eigen::Vector3f center;
+	float radius;
+	MeshLodOptions options;
+
+public:
+	// Positions are 3 floats at `positionOffset` in each vertex of `stride` bytes
+	MeshLod(const void* vertices, std::size_t stride, std::size_t positionOffset, std::size_t vertexCount,
+		const uint32_t* indices, std::size_t indexCount, const MeshLodOptions& options = MeshLodOptions());
+
+	int getLevelCount() const noexcept { return static_cast<int>(levels.size()); }
+	const Level& getLevel(int level) const noexcept { return levels[level]; }
+	const Eigen::Vector3f& getBoundingCenter() const noexcept { return center; }
+	float getBoundingRadius() const noexcept { return radius; }
+
+	// Radius in pixels of the bounding sphere seen through `mvp`, or infinity when it reaches the camera
+	float projectedRadius(const Eigen::Matrix4f& mvp, int viewportWidth, int viewportHeight) const noexcept;
+	// Coarsest level whose error stays within the pixel budget, keeping `currentLevel` inside the hysteresis band
+	int selectLevel(float projectedRadius, int currentLevel) const noexcept;
+	int selectLevel(const Eigen::Matrix4f& mvp, int viewportWidth, int viewportHeight, int currentLevel) const noexcept {
+		return selectLevel(projectedRadius(mvp, viewportWidth, viewportHeight), currentLevel);
+	}
+};
@@ -0,0 +1,186 @@
+#include "MeshletMesh.h"
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+static inline Eigen::Vector3f readPosition(const void* vertices, std::size_t stride, std::size_t offset, std::size_t i) {
+	return Eigen::Vector3f::Map(reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(vertices) + i * stride + offset));
+}
+
+MeshletMesh::MeshletMesh(const void* vertexData, std::size_t stride, std::size_t positionOffset, std::size_t vertexCount,
+	const uint32_t* indexData, std::size_t indexCount, const MeshletOptions& options): indices(indexData, indexData + indexCount)
+{
+	assert(indexCount % 3 == 0 && "Invalid mesh!");
+	assert(options.maxVertices >= 3 && options.maxVertices <= 256 && options.maxTriangles > 0 && "Invalid meshlet options!");
+
+	const std::size_t triangleCount = indexCount / 3;
+
+	std::vector<Eigen::Vector3f> positions(vertexCount);
+	for (std::size_t i = 0; i < vertexCount; ++i)
+		positions[i] = readPosition(vertexData, stride, positionOffset, i);
+
+	// Unit normals, zero for degenerate triangles
+	std::vector<Eigen::Vector3f> normals(triangleCount);
+	for (std::size_t t = 0; t < triangleCount; ++t) {
+		const Eigen::Vector3f& a = positions[indices[3 * t]];
+		const Eigen::Vector3f normal = (positions[indices[3 * t + 1]] - a).cross(positions[indices[3 * t + 2]] - a);
+		const float length = normal.norm();
+		normals[t] = length > 0.0f ? Eigen::Vector3f(normal / length) : Eigen::Vector3f::Zero();
+	}
+
+	// Triangles around each vertex
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	std::vector<uint32_t> adjacency(indexCount);
+	for (std::size_t i = 0; i < indexCount; ++i) {
+		assert(indices[i] < vertexCount && "Vertex array out of index!");
+		adjacencyOffsets[indices[i] + 1]++;
+	}
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	{
+		std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (std::size_t i = 0; i < indexCount; ++i)
+			adjacency[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<bool> assigned(triangleCount, false);
+	// Meshlet vertex of each mesh vertex, for the meshlet being built
+	std::vector<int> slots(vertexCount, -1);
+	std::vector<uint32_t> candidates;
+	std::size_t seed = 0;
+
+	// Meshlets grow from the first free triangle through the triangles sharing their vertices
+	for (;;) {
+		while (seed < triangleCount && assigned[seed])
+			seed++;
+		if (seed == triangleCount)
+			break;
+
+		Meshlet meshlet = {};
+		meshlet.vertexOffset = static_cast<uint32_t>(vertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(primitives.size());
+		Eigen::Vector3f normalSum = Eigen::Vector3f::Zero();
+		candidates.assign(1, static_cast<uint32_t>(seed));
+
+		while (meshlet.triangleCount < options.maxTriangles) {
+			const float normalLength = normalSum.norm();
+			const Eigen::Vector3f axis = normalLength > 0.0f ? Eigen::Vector3f(normalSum / normalLength) : Eigen::Vector3f::Zero();
+
+			int best = -1;
+			float bestScore = FLT_MAX;
+			for (std::size_t c = 0; c < candidates.size();) {
+				const uint32_t t = candidates[c];
+				if (assigned[t]) {
+					candidates[c] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				++c;
+
+				int newVertices = 0;
+				for (int k = 0; k < 3; ++k)
+					newVertices += slots[indices[3 * t + k]] < 0;
+				if (meshlet.vertexCount + newVertices > options.maxVertices)
+					continue;
+
+				const float score = newVertices + options.coneWeight * (1.0f - normals[t].dot(axis));
+				if (score < bestScore) {
+					bestScore = score;
+					best = static_cast<int>(t);
+				}
+			}
+			if (best < 0)
+				break;
+
+			assigned[best] = true;
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t v = indices[3 * best + k];
+				if (slots[v] < 0) {
+					slots[v] = static_cast<int>(meshlet.vertexCount++);
+					vertices.push_back(v);
+					for (uint32_t i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i) {
+						if (!assigned[adjacency[i]])
+							candidates.push_back(adjacency[i]);
+					}
+				}
+				triangles.push_back(static_cast<uint8_t>(slots[v]));
+			}
+			primitives.push_back(static_cast<uint32_t>(best));
+			normalSum += normals[best];
+			meshlet.triangleCount++;
+		}
+
+		const uint32_t* meshletVertices = vertices.data() + meshlet.vertexOffset;
+		Eigen::Vector3f lower = Eigen::Vector3f::Constant(FLT_MAX);
+		Eigen::Vector3f upper = -lower;
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+			lower = lower.cwiseMin(positions[meshletVertices[i]]);
+			upper = upper.cwiseMax(positions[meshletVertices[i]]);
+			slots[meshletVertices[i]] = -1;
+		}
+
+		meshlet.center = (lower + upper) / 2;
+		meshlet.radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			meshlet.radius = std::max(meshlet.radius, (positions[meshletVertices[i]] - meshlet.center).norm());
+
+		// Degenerate triangles are never rasterized and do not widen the cone
+		meshlet.coneAxis = normalSum.norm() > 0.0f ? Eigen::Vector3f(normalSum.normalized()) : Eigen::Vector3f::Zero();
+		meshlet.coneCos = meshlet.coneAxis.isZero() ? -1.0f : 1.0f;
+		for (uint32_t i = 0; i < meshlet.triangleCount; ++i) {
+			const Eigen::Vector3f& normal = normals[primitives[meshlet.triangleOffset + i]];
+			if (!normal.isZero())
+				meshlet.coneCos = std::min(meshlet.coneCos, normal.dot(meshlet.coneAxis));
+		}
+		meshlet.coneSin = std::sqrt(std::max(1.0f - meshlet.coneCos * meshlet.coneCos, 0.0f));
+
+		meshlets.push_back(meshlet);
+	}
+}
+
+MeshletMesh::MeshletMesh(std::vector<Meshlet> meshlets, std::vector<uint32_t> vertices, std::vector<uint8_t> triangles,
+	std::vector<uint32_t> primitives, std::vector<uint32_t> indices):
+	meshlets(std::move(meshlets)), vertices(std::move(vertices)), triangles(std::move(triangles)),
+	primitives(std::move(primitives)), indices(std::move(indices))
+{
+	assert(this->triangles.size() == this->primitives.size() * 3 && "Invalid meshlet tables!");
+}
+
+MeshletMesh::View::View(const Eigen::Matrix4f& objectToClip): frustum(objectToClip)
+{
+	const Eigen::Matrix4f clipToObject = objectToClip.inverse();
+
+	// The camera is the point projected to x = y = w = 0
+	eye = clipToObject * Eigen::Vector4f(0.0f, 0.0f, 1.0f, 0.0f);
+
+	// Unproject a triangle which is counter clockwise on screen, the winding kept by backface culling.
+	// Its side facing the camera is the front of every triangle, whatever the handedness of the transform.
+	auto unproject = [&](float x, float y) {
+		const Eigen::Vector4f point = clipToObject * Eigen::Vector4f(x, y, 0.0f, 1.0f);
+		return Eigen::Vector3f(point.head<3>() / point.w());
+	};
+	const Eigen::Vector3f a = unproject(0.0f, 0.0f);
+	const Eigen::Vector3f normal = (unproject(0.5f, 0.0f) - a).cross(unproject(0.0f, 0.5f) - a);
+	frontSign = normal.dot(eye.head<3>() - a * eye.w()) >= 0.0f ? 1.0f : -1.0f;
+}
+
+bool MeshletMesh::View::isInsideFrustum(const Meshlet& meshlet) const noexcept
+{
+	return frustum.intersectsSphere(meshlet.center, meshlet.radius);
+}
+
+bool MeshletMesh::View::isBackFacing(const Meshlet& meshlet) const noexcept
+{
+	if (meshlet.coneCos <= 0.0f)
+		return false;
+
+	// A triangle faces the camera when frontSign * dot(normal, eye - position * eye.w) is positive.
+	// Bound that from above over every normal of the cone and every position of the sphere.
+	const Eigen::Vector3f toEye = eye.head<3>() - meshlet.center * eye.w();
+	const float along = frontSign * meshlet.coneAxis.dot(toEye);
+	const float across = std::sqrt(std::max(toEye.squaredNorm() - along * along, 0.0f));
+
+	return along * meshlet.coneCos + across * meshlet.coneSin < -std::fabs(eye.w()) * meshlet.radius;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+#include "Frustum.h"
+
+struct MeshletOptions {
+	// Meshlet vertices are addressed with 8 bits, so at most 256
+	std::size_t maxVertices = 64;
+	std::size_t maxTriangles = 124;
+	// Cost of a triangle bending away from the meshlet normal, against one more vertex to shade.
+	// Higher values give tighter normal cones, and more meshlets.
+	float coneWeight = 2.0f;
+};
+
+// Index buffer split into small clusters of neighbouring triangles. Each meshlet has a bounding sphere
+// and a cone bounding its triangle normals, which reject it before any of its vertices is shaded when
+// it is outside the view or faces away from the camera. Like MeshLod, meshlets index the original vertices.
+class MeshletMesh
+{
+public:
+	struct Meshlet {
+		// Ranges of `vertices`, and of `triangles` and `primitives`
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+		uint32_t triangleOffset;
+		uint32_t triangleCount;
+
+		Eigen::Vector3f center;
+		float radius;
+		// Every triangle normal is within the angle of cosine coneCos around coneAxis.
+		// A cone of 90 degrees or more never rejects the meshlet.
+		Eigen::Vector3f coneAxis;
+		float coneCos;
+		float coneSin;
+	};
+
+	// Culling state of one view, built once per draw
+	class View
+	{
+		Frustum frustum;
+		// Camera in object space, a direction when w is 0
+		Eigen::Vector4f eye;
+		// Which side of the triangles the camera sees for them to be front facing on screen
+		float frontSign;
+
+	public:
+		// `objectToClip` must be the transform the vertex shader applies to the positions
+		explicit View(const Eigen::Matrix4f& objectToClip);
+
+		bool isInsideFrustum(const Meshlet& meshlet) const noexcept;
+		bool isBackFacing(const Meshlet& meshlet) const noexcept;
+		bool isVisible(const Meshlet& meshlet) const noexcept { return isInsideFrustum(meshlet) && !isBackFacing(meshlet); }
+	};
+
+private:
+	std::vector<Meshlet> meshlets;
+	// Mesh vertex of each meshlet vertex
+	std::vector<uint32_t> vertices;
+	// Three meshlet vertices per triangle
+	std::vector<uint8_t> triangles;
+	// Position of each triangle in the source index buffer, its primitive ID
+	std::vector<uint32_t> primitives;
+	std::vector<uint32_t> indices;
+
+public:
+	// Positions are 3 floats at `positionOffset` in each vertex of `stride` bytes
+	MeshletMesh(const void* vertices, std::size_t stride, std::size_t positionOffset, std::size_t vertexCount,
+		const uint32_t* indices, std::size_t indexCount, const MeshletOptions& options = MeshletOptions());
+	// Takes the tables of a mesh which was already split, as a capture stores them
+	MeshletMesh(std::vector<Meshlet> meshlets, std::vector<uint32_t> vertices, std::vector<uint8_t> triangles,
+		std::vector<uint32_t> primitives, std::vector<uint32_t> indices);
+
+	std::size_t getMeshletCount() const noexcept { return meshlets.size(); }
+	const Meshlet& getMeshlet(std::size_t i) const noexcept { return meshlets[i]; }
+	const uint32_t* getMeshletVertices(const Meshlet& meshlet) const noexcept { return vertices.data() + meshlet.vertexOffset; }
+	const uint8_t* getMeshletTriangles(const Meshlet& meshlet) const noexcept { return triangles.data() + meshlet.triangleOffset * 3; }
+	const uint32_t* getMeshletPrimitives(const Meshlet& meshlet) const noexcept { return primitives.data() + meshlet.triangleOffset; }
+
+	const std::vector<Meshlet>& getMeshlets() const noexcept { return meshlets; }
+	const std::vector<uint32_t>& getVertices() const noexcept { return vertices; }
+	const std::vector<uint8_t>& getTriangles() const noexcept { return triangles; }
+	const std::vector<uint32_t>& getPrimitives() const noexcept { return primitives; }
+	// The source index buffer, for drawing the mesh without meshlets
+	const std::vector<uint32_t>& getIndices() const noexcept { return indices; }
+};
@@ -0,0 +1,62 @@
+#include "PipelineState.h"
+#include "Rasterizer.h"
+
+PipelineState::PipelineState(const PipelineStateDesc& desc, RasterKernel kernel): desc(desc), kernel(kernel)
+{
+}
+
+std::shared_ptr<const PipelineState> PipelineState::create(const PipelineStateDesc& desc)
+{
+	return std::shared_ptr<const PipelineState>(new PipelineState(desc, Rasterizer::selectKernel(desc)));
+}
+
+PipelineStateDesc PipelineState::depthPrepass(const PipelineStateDesc& desc)
+{
+	PipelineStateDesc prepass = desc;
+	prepass.drawStyle = DrawStyle::TRIANGLES;
+	prepass.zBufferEnabled = true;
+	prepass.depthFunc = DepthFunc::GREATER;
+	prepass.colorWrite = false;
+	prepass.depthWrite = true;
+	return prepass;
+}
+
+PipelineStateDesc PipelineState::equalDepthColorPass(const PipelineStateDesc& desc)
+{
+	PipelineStateDesc colorPass = desc;
+	colorPass.drawStyle = DrawStyle::TRIANGLES;
+	colorPass.zBufferEnabled = true;
+	colorPass.depthFunc = DepthFunc::EQUAL;
+	colorPass.colorWrite = true;
+	colorPass.depthWrite = false;
+	return colorPass;
+}
+
+VaryingLayout PipelineState::buildVaryingLayout(const IShader::ShaderDescriptor& shader) const
+{
+	VaryingLayout layout;
+	const auto &varyings = shader.varyings;
+	const uint32_t channels = static_cast<uint32_t>(varyings.size());
+	const uint32_t positionPlacement = static_cast<uint32_t>(shader.positionPlacement);
+	bool anyPerspective = false;
+
+	for (uint32_t c = 0; c < channels;) {
+		const auto interpolation = varyings[c];
+		const bool position = c - positionPlacement < 4;
+		uint32_t end = c + 1;
+		while (end < channels && varyings[end] == interpolation && (end - positionPlacement < 4) == position)
+			end++;
+
+		if (interpolation == IShader::Interpolation::SMOOTH || interpolation == IShader::Interpolation::NOPERSPECTIVE) {
+			const bool perspective = desc.perspectiveCorrect && !position && interpolation == IShader::Interpolation::SMOOTH;
+			layout.runs.push_back({ c, layout.packedSize, end - c, perspective });
+			layout.packedSize += end - c;
+			anyPerspective = anyPerspective || perspective;
+		}
+		c = end;
+	}
+
+	if (anyPerspective)
+		layout.scaleChannel = static_cast<int>(layout.packedSize++);
+	return layout;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <eigen3/Eigen/Eigen>
+#include <vector>
+#include "DepthBuffer.h"
+#include "IShader.h"
+
+class SoftwareRenderer;
+struct RenderContext;
+
+enum class DrawStyle {
+	TRIANGLES,
+	TRIANGLES_WIREFRAME,
+};
+
+struct PipelineStateDesc {
+	DrawStyle drawStyle = DrawStyle::TRIANGLES;
+	bool backfaceCull = false;
+	uint8_t sampleDensity = 0;
+	bool zBufferEnabled = false;
+	// must match the depth buffer bound when drawing with zBufferEnabled
+	DepthFormat depthFormat = DepthFormat::FLOAT32;
+	DepthFunc depthFunc = DepthFunc::GREATER;
+	bool perspectiveCorrect = false;
+	// Without color writes the fragment shader is skipped, discards included
+	bool colorWrite = true;
+	bool depthWrite = true;
+};
+
+// Vertex output channels a pipeline interpolates for a shader declaring its varyings. Live channels
+// are packed by runs of the same interpolation, SMOOTH ones premultiplied by 1/w and followed by 1/w
+// itself. Other channels keep the values of the first vertex.
+struct VaryingLayout {
+	struct Run {
+		uint32_t channel;
+		uint32_t packed;
+		uint32_t size;
+		bool perspective;
+	};
+	std::vector<Run> runs;
+	uint32_t packedSize = 0;
+	// Packed channel holding 1/w, or -1 without perspective correct runs
+	int scaleChannel = -1;
+};
+
+// Immutable bundle of raster state. The raster kernel is picked once at creation
+// among variants specialized at compile time, so none of the state is tested per pixel.
+class PipelineState
+{
+public:
+	using RasterKernel = void (*)(SoftwareRenderer *renderer, RenderContext *ctx, Eigen::VectorXf vertices[3]);
+
+private:
+	const PipelineStateDesc desc;
+	const RasterKernel kernel;
+
+	PipelineState(const PipelineStateDesc& desc, RasterKernel kernel);
+
+public:
+	static std::shared_ptr<const PipelineState> create(const PipelineStateDesc& desc);
+
+	// Z-prepass pair built from a color pass description: the prepass only writes depth,
+	// the color pass then shades each pixel once, where its depth equals the prepass result.
+	static PipelineStateDesc depthPrepass(const PipelineStateDesc& desc);
+	static PipelineStateDesc equalDepthColorPass(const PipelineStateDesc& desc);
+
+	// Built when a draw first uses the pipeline with a shader, not per triangle
+	VaryingLayout buildVaryingLayout(const IShader::ShaderDescriptor& shader) const;
+
+	const PipelineStateDesc& getDesc() const noexcept { return desc; }
+	RasterKernel getKernel() const noexcept { return kernel; }
+};
@@ -0,0 +1,482 @@
+#include "PixelFormat.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Expand 4 mask bytes to four 32-bit lanes of all ones / all zeros
+static inline __m128i expandMask32(const uint8_t* mask) {
+	uint32_t bits;
+	std::memcpy(&bits, mask, sizeof(bits));
+	__m128i m = _mm_cvtsi32_si128(static_cast<int>(bits));
+	m = _mm_unpacklo_epi8(m, m);
+	m = _mm_unpacklo_epi16(m, m);
+	return _mm_cmpgt_epi32(_mm_and_si128(m, _mm_set1_epi32(0xFF)), _mm_setzero_si128());
+}
+
+static inline uint32_t maskBits4(const uint8_t* mask) {
+	uint32_t bits;
+	std::memcpy(&bits, mask, sizeof(bits));
+	return bits;
+}
+
+static inline __m128 clampUnit(__m128 v) {
+	return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+// RGBA -> BGRA, then truncate to integers as the scalar path does
+static inline __m128i toBGRA8888(const float* color, __m128 scale) {
+	const __m128 c = _mm_loadu_ps(color);
+	return _mm_cvttps_epi32(_mm_mul_ps(clampUnit(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 1, 2))), scale));
+}
+
+static inline uint32_t packBGRA8888(const float c[4]) {
+	uint8_t color[4];
+	color[0] = static_cast<uint8_t>(std::min(std::max(c[2], 0.0f), 1.0f) * 255);
+	color[1] = static_cast<uint8_t>(std::min(std::max(c[1], 0.0f), 1.0f) * 255);
+	color[2] = static_cast<uint8_t>(std::min(std::max(c[0], 0.0f), 1.0f) * 255);
+	color[3] = static_cast<uint8_t>(std::min(std::max(c[3], 0.0f), 1.0f) * 255);
+
+	uint32_t packed;
+	std::memcpy(&packed, color, sizeof(packed));
+	return packed;
+}
+
+static inline uint16_t packRGB565(const float c[4]) {
+	const int r = static_cast<int>(lroundf(std::min(std::max(c[0], 0.0f), 1.0f) * 31));
+	const int g = static_cast<int>(lroundf(std::min(std::max(c[1], 0.0f), 1.0f) * 63));
+	const int b = static_cast<int>(lroundf(std::min(std::max(c[2], 0.0f), 1.0f) * 31));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void packRowBGRA8888(const float* colors, const uint8_t* mask, uint32_t* dst, int count) {
+	const __m128 scale = _mm_set1_ps(255.0f);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		const uint32_t bits = mask ? maskBits4(mask + i) : 0xFFFFFFFF;
+		if (bits == 0) continue;
+
+		const __m128i p0 = toBGRA8888(colors + 4 * i + 0, scale);
+		const __m128i p1 = toBGRA8888(colors + 4 * i + 4, scale);
+		const __m128i p2 = toBGRA8888(colors + 4 * i + 8, scale);
+		const __m128i p3 = toBGRA8888(colors + 4 * i + 12, scale);
+
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+		__m128i* target = reinterpret_cast<__m128i*>(dst + i);
+
+		if (bits != 0xFFFFFFFF) {
+			const __m128i m = expandMask32(mask + i);
+			packed = _mm_or_si128(_mm_and_si128(m, packed), _mm_andnot_si128(m, _mm_loadu_si128(target)));
+		}
+		_mm_storeu_si128(target, packed);
+	}
+
+	for (; i < count; ++i) {
+		if (!mask || mask[i])
+			dst[i] = packBGRA8888(colors + 4 * i);
+	}
+}
+
+static void packRowRGB565(const float* colors, const uint8_t* mask, uint16_t* dst, int count) {
+	const __m128 scaleRB = _mm_set1_ps(31.0f);
+	const __m128 scaleG = _mm_set1_ps(63.0f);
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128i unbias = _mm_set1_epi16(static_cast<short>(0x8000));
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		const uint32_t bits = mask ? maskBits4(mask + i) : 0xFFFFFFFF;
+		if (bits == 0) continue;
+
+		__m128 r = _mm_loadu_ps(colors + 4 * i + 0);
+		__m128 g = _mm_loadu_ps(colors + 4 * i + 4);
+		__m128 b = _mm_loadu_ps(colors + 4 * i + 8);
+		__m128 a = _mm_loadu_ps(colors + 4 * i + 12);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+
+		const __m128i ri = _mm_cvtps_epi32(_mm_mul_ps(clampUnit(r), scaleRB));
+		const __m128i gi = _mm_cvtps_epi32(_mm_mul_ps(clampUnit(g), scaleG));
+		const __m128i bi = _mm_cvtps_epi32(_mm_mul_ps(clampUnit(b), scaleRB));
+		__m128i packed = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ri, 11), _mm_slli_epi32(gi, 5)), bi);
+
+		// 16-bit unsigned pack through the signed saturating one
+		packed = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(packed, bias), _mm_setzero_si128()), unbias);
+
+		__m128i* target = reinterpret_cast<__m128i*>(dst + i);
+		if (bits != 0xFFFFFFFF) {
+			__m128i m = _mm_cvtsi32_si128(static_cast<int>(bits));
+			m = _mm_cmpgt_epi16(_mm_and_si128(_mm_unpacklo_epi8(m, m), _mm_set1_epi16(0xFF)), _mm_setzero_si128());
+			packed = _mm_or_si128(_mm_and_si128(m, packed), _mm_andnot_si128(m, _mm_loadl_epi64(target)));
+		}
+		_mm_storel_epi64(target, packed);
+	}
+
+	for (; i < count; ++i) {
+		if (!mask || mask[i])
+			dst[i] = packRGB565(colors + 4 * i);
+	}
+}
+
+static void packRowRGBA32F(const float* colors, const uint8_t* mask, float* dst, int count) {
+	// HDR target: no clamping, colors are kept as they come out of the fragment shader
+	for (int i = 0; i < count; ++i) {
+		if (!mask || mask[i])
+			_mm_storeu_ps(dst + 4 * i, _mm_loadu_ps(colors + 4 * i));
+	}
+}
+
+SurfaceAddressing::SurfaceAddressing(SurfaceLayout layout, int w, std::size_t pitch, std::size_t pixelStep) noexcept:
+	pixelStep(pixelStep)
+{
+	const std::size_t tilesX = std::size_t(w + TILE_SIZE - 1) / TILE_SIZE;
+
+	if (layout == SurfaceLayout::TILED) {
+		lineStep = TILE_SIZE * pixelStep;
+		tileStep = TILE_SIZE * TILE_SIZE * pixelStep;
+		tileRowStep = tilesX * tileStep;
+	}
+	else {
+		lineStep = pitch;
+		tileStep = TILE_SIZE * pixelStep;
+		tileRowStep = TILE_SIZE * pitch;
+	}
+}
+
+std::size_t SurfaceAddressing::tiledSize(int w, int h, std::size_t pixelStep) noexcept
+{
+	const std::size_t tilesX = std::size_t(w + TILE_SIZE - 1) / TILE_SIZE;
+	const std::size_t tilesY = std::size_t(h + TILE_SIZE - 1) / TILE_SIZE;
+	return tilesX * tilesY * TILE_SIZE * TILE_SIZE * pixelStep;
+}
+
+std::size_t PixelPacker::bytesPerPixel(PixelFormat format) noexcept
+{
+	switch (format) {
+	case PixelFormat::BGRA8888:	return sizeof(uint32_t);
+	case PixelFormat::RGB565:	return sizeof(uint16_t);
+	case PixelFormat::RGBA32F:	return 4 * sizeof(float);
+	}
+	return 0;
+}
+
+void PixelPacker::packRow(PixelFormat format, const float* colors, const uint8_t* mask, void* dst, int count) noexcept
+{
+	switch (format) {
+	case PixelFormat::BGRA8888:
+		packRowBGRA8888(colors, mask, reinterpret_cast<uint32_t*>(dst), count);
+		break;
+	case PixelFormat::RGB565:
+		packRowRGB565(colors, mask, reinterpret_cast<uint16_t*>(dst), count);
+		break;
+	case PixelFormat::RGBA32F:
+		packRowRGBA32F(colors, mask, reinterpret_cast<float*>(dst), count);
+		break;
+	}
+}
+
+void PixelPacker::packColor(PixelFormat format, const float color[4], void* dst) noexcept
+{
+	switch (format) {
+	case PixelFormat::BGRA8888: {
+		const uint32_t packed = packBGRA8888(color);
+		std::memcpy(dst, &packed, sizeof(packed));
+		break;
+	}
+	case PixelFormat::RGB565: {
+		const uint16_t packed = packRGB565(color);
+		std::memcpy(dst, &packed, sizeof(packed));
+		break;
+	}
+	case PixelFormat::RGBA32F:
+		std::memcpy(dst, color, 4 * sizeof(float));
+		break;
+	}
+}
+
+void PixelPacker::convertImage(const void* src, int srcPitch, PixelFormat srcFormat,
+	void* dst, int dstPitch, PixelFormat dstFormat, int w, int h) noexcept
+{
+	assert((srcFormat == dstFormat || srcFormat == PixelFormat::RGBA32F) && "Unsupported conversion!");
+
+	const uint8_t* srcRow = reinterpret_cast<const uint8_t*>(src);
+	uint8_t* dstRow = reinterpret_cast<uint8_t*>(dst);
+
+	for (int y = 0; y < h; ++y) {
+		if (srcFormat == dstFormat)
+			std::memcpy(dstRow, srcRow, std::size_t(w) * bytesPerPixel(dstFormat));
+		else
+			packRow(dstFormat, reinterpret_cast<const float*>(srcRow), nullptr, dstRow, w);
+
+		srcRow += srcPitch;
+		dstRow += dstPitch;
+	}
+}
+
+// Source coordinate of every destination column or row: the first of the two samples and
+// the weight of the second one, in 1/128 so that weighted 8-bit differences fit 16-bit lanes
+struct ScaleTap {
+	int index;
+	int weight;
+};
+
+static void computeScaleTaps(int srcSize, int dstSize, std::vector<ScaleTap>& taps)
+{
+	taps.resize(dstSize);
+	const float ratio = float(srcSize) / dstSize;
+
+	for (int i = 0; i < dstSize; ++i) {
+		const float position = std::min(std::max((i + 0.5f) * ratio - 0.5f, 0.0f), float(srcSize - 1));
+		const int index = std::min(static_cast<int>(position), srcSize - 1);
+		taps[i] = { index, static_cast<int>(lroundf((position - index) * 128)) };
+	}
+}
+
+static void scaleImageBGRA8888(const uint8_t* src, int srcPitch, int srcW, int srcH,
+	uint8_t* dst, int dstPitch, int dstW, int dstH)
+{
+	std::vector<ScaleTap> columns, rows;
+	computeScaleTaps(srcW, dstW, columns);
+	computeScaleTaps(srcH, dstH, rows);
+
+	// Vertically blended source row, 16 bits per channel, with the last pixel repeated
+	// so the right sample of the last column can be loaded along with the left one
+	std::vector<int16_t> blended(std::size_t(srcW + 2) * 4);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(64);
+
+	for (int y = 0; y < dstH; ++y) {
+		const uint8_t* row0 = src + std::size_t(rows[y].index) * srcPitch;
+		const uint8_t* row1 = src + std::size_t(std::min(rows[y].index + 1, srcH - 1)) * srcPitch;
+		const __m128i wy = _mm_set1_epi16(static_cast<short>(rows[y].weight));
+
+		int x = 0;
+		for (; x + 2 <= srcW; x += 2) {
+			const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row0 + 4 * x)), zero);
+			const __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row1 + 4 * x)), zero);
+			const __m128i delta = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), wy), round), 7);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(blended.data() + 4 * x), _mm_add_epi16(a, delta));
+		}
+		for (; x < srcW; ++x) {
+			for (int c = 0; c < 4; ++c) {
+				const int a = row0[4 * x + c];
+				const int b = row1[4 * x + c];
+				blended[4 * x + c] = static_cast<int16_t>(a + (((b - a) * rows[y].weight + 64) >> 7));
+			}
+		}
+		std::memcpy(blended.data() + 4 * srcW, blended.data() + 4 * (srcW - 1), 4 * sizeof(int16_t));
+
+		uint8_t* dstRow = dst + std::size_t(y) * dstPitch;
+		x = 0;
+		for (; x + 2 <= dstW; x += 2) {
+			const ScaleTap& t0 = columns[x];
+			const ScaleTap& t1 = columns[x + 1];
+
+			// Both samples of each column in one load, then left samples in the low half and right ones in the high half
+			const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blended.data() + 4 * t0.index));
+			const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blended.data() + 4 * t1.index));
+			const __m128i left = _mm_unpacklo_epi64(p0, p1);
+			const __m128i right = _mm_unpackhi_epi64(p0, p1);
+
+			const __m128i wx = _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<short>(t0.weight)), _mm_set1_epi16(static_cast<short>(t1.weight)));
+			const __m128i delta = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(right, left), wx), round), 7);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dstRow + 4 * x), _mm_packus_epi16(_mm_add_epi16(left, delta), zero));
+		}
+		for (; x < dstW; ++x) {
+			const ScaleTap& t = columns[x];
+			for (int c = 0; c < 4; ++c) {
+				const int a = blended[4 * t.index + c];
+				const int b = blended[4 * t.index + 4 + c];
+				dstRow[4 * x + c] = static_cast<uint8_t>(a + (((b - a) * t.weight + 64) >> 7));
+			}
+		}
+	}
+}
+
+template <typename Pixel, int Channels, typename Decode, typename Encode>
+static void scaleImageGeneric(const uint8_t* src, int srcPitch, int srcW, int srcH,
+	uint8_t* dst, int dstPitch, int dstW, int dstH, Decode decode, Encode encode)
+{
+	std::vector<ScaleTap> columns, rows;
+	computeScaleTaps(srcW, dstW, columns);
+	computeScaleTaps(srcH, dstH, rows);
+
+	auto sample = [&](int x, int y, float* out) {
+		Pixel pixel;
+		std::memcpy(&pixel, src + std::size_t(y) * srcPitch + std::size_t(x) * sizeof(Pixel), sizeof(Pixel));
+		decode(pixel, out);
+	};
+
+	for (int y = 0; y < dstH; ++y) {
+		const int y0 = rows[y].index;
+		const int y1 = std::min(y0 + 1, srcH - 1);
+		const float wy = rows[y].weight / 128.0f;
+
+		for (int x = 0; x < dstW; ++x) {
+			const int x0 = columns[x].index;
+			const int x1 = std::min(x0 + 1, srcW - 1);
+			const float wx = columns[x].weight / 128.0f;
+
+			float c00[Channels], c01[Channels], c10[Channels], c11[Channels], result[Channels];
+			sample(x0, y0, c00);
+			sample(x1, y0, c01);
+			sample(x0, y1, c10);
+			sample(x1, y1, c11);
+			for (int c = 0; c < Channels; ++c) {
+				const float top = c00[c] + (c01[c] - c00[c]) * wx;
+				const float bottom = c10[c] + (c11[c] - c10[c]) * wx;
+				result[c] = top + (bottom - top) * wy;
+			}
+
+			const Pixel pixel = encode(result);
+			std::memcpy(dst + std::size_t(y) * dstPitch + std::size_t(x) * sizeof(Pixel), &pixel, sizeof(Pixel));
+		}
+	}
+}
+
+void PixelPacker::scaleImage(const void* src, int srcPitch, int srcW, int srcH,
+	void* dst, int dstPitch, int dstW, int dstH, PixelFormat format) noexcept
+{
+	assert(srcW > 0 && srcH > 0 && dstW > 0 && dstH > 0 && "Invalid image size!");
+
+	if (srcW == dstW && srcH == dstH) {
+		convertImage(src, srcPitch, format, dst, dstPitch, format, dstW, dstH);
+		return;
+	}
+
+	const uint8_t* srcBytes = reinterpret_cast<const uint8_t*>(src);
+	uint8_t* dstBytes = reinterpret_cast<uint8_t*>(dst);
+
+	switch (format) {
+	case PixelFormat::BGRA8888:
+		scaleImageBGRA8888(srcBytes, srcPitch, srcW, srcH, dstBytes, dstPitch, dstW, dstH);
+		break;
+	case PixelFormat::RGB565:
+		scaleImageGeneric<uint16_t, 3>(srcBytes, srcPitch, srcW, srcH, dstBytes, dstPitch, dstW, dstH,
+			[](uint16_t p, float* c) { c[0] = float(p >> 11); c[1] = float((p >> 5) & 0x3F); c[2] = float(p & 0x1F); },
+			[](const float* c) {
+				return static_cast<uint16_t>((lroundf(c[0]) << 11) | (lroundf(c[1]) << 5) | lroundf(c[2]));
+			});
+		break;
+	case PixelFormat::RGBA32F: {
+		struct Color { float c[4]; };
+		scaleImageGeneric<Color, 4>(srcBytes, srcPitch, srcW, srcH, dstBytes, dstPitch, dstW, dstH,
+			[](const Color& p, float* c) { std::memcpy(c, p.c, sizeof(p.c)); },
+			[](const float* c) { Color p; std::memcpy(p.c, c, sizeof(p.c)); return p; });
+		break;
+	}
+	}
+}
+
+// BT.601 limited range, 8-bit fixed point weights of (B, G, R)
+static constexpr int lumaWeights[3] = { 25, 129, 66 };
+static constexpr int blueWeights[3] = { 112, -74, -38 };
+static constexpr int redWeights[3] = { -18, -94, 112 };
+
+static inline uint8_t lumaOf(const uint8_t* p) {
+	return static_cast<uint8_t>(((lumaWeights[0] * p[0] + lumaWeights[1] * p[1] + lumaWeights[2] * p[2] + 128) >> 8) + 16);
+}
+
+// Chroma of the sum of 4 pixels
+static inline uint8_t chromaOf(const int sum[3], const int weights[3]) {
+	return static_cast<uint8_t>(((weights[0] * sum[0] + weights[1] * sum[1] + weights[2] * sum[2] + 512) >> 10) + 128);
+}
+
+// Dot products of 4 pixels with the weights, from the 16-bit channels of 2 pixels per register
+static inline __m128i weighPixels(__m128i pixels01, __m128i pixels23, __m128i weights) {
+	const __m128 products01 = _mm_castsi128_ps(_mm_madd_epi16(pixels01, weights));
+	const __m128 products23 = _mm_castsi128_ps(_mm_madd_epi16(pixels23, weights));
+	// (B, G) and (R, A) products of each pixel are added
+	return _mm_add_epi32(
+		_mm_castps_si128(_mm_shuffle_ps(products01, products23, _MM_SHUFFLE(2, 0, 2, 0))),
+		_mm_castps_si128(_mm_shuffle_ps(products01, products23, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+static inline __m128i pixelWeights(const int weights[3]) {
+	return _mm_setr_epi16(short(weights[0]), short(weights[1]), short(weights[2]), 0,
+		short(weights[0]), short(weights[1]), short(weights[2]), 0);
+}
+
+static void convertLumaRow(const uint8_t* src, uint8_t* dst, int w) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weights = pixelWeights(lumaWeights);
+	const __m128i round = _mm_set1_epi32(128);
+	const __m128i offset = _mm_set1_epi16(16);
+
+	int x = 0;
+	for (; x + 8 <= w; x += 8) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * x));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * x + 16));
+		const __m128i lumaA = _mm_srai_epi32(_mm_add_epi32(weighPixels(_mm_unpacklo_epi8(a, zero), _mm_unpackhi_epi8(a, zero), weights), round), 8);
+		const __m128i lumaB = _mm_srai_epi32(_mm_add_epi32(weighPixels(_mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero), weights), round), 8);
+		const __m128i luma = _mm_add_epi16(_mm_packs_epi32(lumaA, lumaB), offset);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(luma, luma));
+	}
+	for (; x < w; ++x)
+		dst[x] = lumaOf(src + 4 * x);
+}
+
+// One chroma row from two source rows, which are the same row at the bottom of odd heights
+static void convertChromaRow(const uint8_t* row0, const uint8_t* row1, uint8_t* u, uint8_t* v, int w) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i blue = pixelWeights(blueWeights);
+	const __m128i red = pixelWeights(redWeights);
+	const __m128i round = _mm_set1_epi32(512);
+	const __m128i offset = _mm_set1_epi16(128);
+
+	// Sums of 2x2 pixels for 2 chroma samples, their channels in 16-bit lanes
+	auto blockSums = [&](__m128i top, __m128i bottom) {
+		const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+		const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+		// pixels 0 + 1 in the low half, 2 + 3 in the high half
+		return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+	};
+	auto toChroma = [&](__m128i sums01, __m128i sums23, __m128i weights) {
+		// weighPixels() gives 4 samples from 4 pixel sums laid out 2 per register
+		const __m128i chroma = _mm_srai_epi32(_mm_add_epi32(weighPixels(sums01, sums23, weights), round), 10);
+		const __m128i packed = _mm_add_epi16(_mm_packs_epi32(chroma, chroma), offset);
+		return _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+	};
+
+	const int chromaW = (w + 1) / 2;
+	int x = 0;
+	for (; 2 * x + 8 <= w; x += 4) {
+		const __m128i sums01 = blockSums(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x)));
+		const __m128i sums23 = blockSums(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x + 16)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x + 16)));
+
+		const int uValues = toChroma(sums01, sums23, blue);
+		const int vValues = toChroma(sums01, sums23, red);
+		std::memcpy(u + x, &uValues, 4);
+		std::memcpy(v + x, &vValues, 4);
+	}
+	for (; x < chromaW; ++x) {
+		// The last column of odd widths is counted twice
+		const int x0 = 2 * x;
+		const int x1 = std::min(2 * x + 1, w - 1);
+		int sum[3];
+		for (int c = 0; c < 3; ++c)
+			sum[c] = row0[4 * x0 + c] + row0[4 * x1 + c] + row1[4 * x0 + c] + row1[4 * x1 + c];
+		u[x] = chromaOf(sum, blueWeights);
+		v[x] = chromaOf(sum, redWeights);
+	}
+}
+
+void PixelPacker::convertToI420(const void* src, int srcPitch, int w, int h,
+	uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane) noexcept
+{
+	const uint8_t* srcBytes = reinterpret_cast<const uint8_t*>(src);
+	const int chromaW = (w + 1) / 2;
+
+	for (int y = 0; y < h; ++y)
+		convertLumaRow(srcBytes + std::size_t(y) * srcPitch, yPlane + std::size_t(y) * w, w);
+
+	for (int y = 0; y < (h + 1) / 2; ++y) {
+		const uint8_t* row0 = srcBytes + std::size_t(2 * y) * srcPitch;
+		const uint8_t* row1 = srcBytes + std::size_t(std::min(2 * y + 1, h - 1)) * srcPitch;
+		convertChromaRow(row0, row1, uPlane + std::size_t(y) * chromaW, vPlane + std::size_t(y) * chromaW, w);
+	}
+}
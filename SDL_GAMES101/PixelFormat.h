@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+enum class PixelFormat {
+	BGRA8888,
+	RGB565,
+	RGBA32F,
+};
+
+// Memory order of the pixels of a surface
+enum class SurfaceLayout {
+	LINEAR,	// rows one after another
+	TILED,	// 8x8 blocks of contiguous pixels, stored in rows of blocks
+};
+
+// Offset of pixel (x, y) is row(y) + column(x), in whatever unit `pixelStep` is given in.
+// A linear surface is addressed as tiles one pixel wide on each row, so both layouts share the arithmetic.
+struct SurfaceAddressing {
+	static constexpr int TILE_SIZE = 8;
+
+	std::size_t pixelStep = 0;
+	std::size_t lineStep = 0;
+	std::size_t tileStep = 0;
+	std::size_t tileRowStep = 0;
+
+	SurfaceAddressing() = default;
+	// `pitch` is the distance between rows of a linear surface; tiled surfaces are padded to whole tiles
+	SurfaceAddressing(SurfaceLayout layout, int w, std::size_t pitch, std::size_t pixelStep) noexcept;
+
+	std::size_t row(int y) const noexcept { return std::size_t(y >> 3) * tileRowStep + std::size_t(y & 7) * lineStep; }
+	std::size_t column(int x) const noexcept { return std::size_t(x >> 3) * tileStep + std::size_t(x & 7) * pixelStep; }
+
+	static std::size_t tiledSize(int w, int h, std::size_t pixelStep) noexcept;
+};
+
+class PixelPacker
+{
+public:
+	static std::size_t bytesPerPixel(PixelFormat format) noexcept;
+
+	// Convert `count` RGBA float colors (4 floats per pixel) into `format` and store them to `dst`.
+	// Only pixels with a non-zero byte in `mask` are written; pass nullptr to write all of them.
+	static void packRow(PixelFormat format, const float* colors, const uint8_t* mask, void* dst, int count) noexcept;
+
+	// Pack a single color, writing bytesPerPixel(format) bytes to `dst`
+	static void packColor(PixelFormat format, const float color[4], void* dst) noexcept;
+
+	// Copy an image to another surface, converting RGBA32F sources (e.g. HDR targets) on the way
+	static void convertImage(const void* src, int srcPitch, PixelFormat srcFormat,
+		void* dst, int dstPitch, PixelFormat dstFormat, int w, int h) noexcept;
+
+	// Bilinear resample of an image to another size in the same format, sampling pixel centers
+	static void scaleImage(const void* src, int srcPitch, int srcW, int srcH,
+		void* dst, int dstPitch, int dstW, int dstH, PixelFormat format) noexcept;
+
+	// Convert a BGRA8888 image to planar 4:2:0 YUV (BT.601, limited range), chroma averaged over 2x2 pixels.
+	// Planes are packed: `w` bytes per luma row and (w + 1) / 2 per chroma row.
+	static void convertToI420(const void* src, int srcPitch, int w, int h,
+		uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane) noexcept;
+};
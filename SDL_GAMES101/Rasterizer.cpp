@@ -1,7 +1,11 @@
 #include "Rasterizer.h"
 #include "SoftwareRenderer.h"
 #include "IShader.h"
+#include "PixelFormat.h"
+#include <cassert>
 #include <cmath>
+#include <cfloat>
+#include <cstring>
 
 #define ABS(x) ((x) >= 0 ? (x) : -(x))
 
@@ -117,16 +121,17 @@ static bool line_clipping(int Xmin, int Xmax, int Ymin, int Ymax, int& x0, int&
 	return true;
 }
 
-void Rasterizer::bresenhamDrawLine(uint32_t* surface, int pitch, int w, int h, int x1, int y1, int x2, int y2, uint32_t color)
+template <typename Plot>
+static void walkLine(int Xmin, int Xmax, int Ymin, int Ymax, int x1, int y1, int x2, int y2, Plot plot)
 {
-	if (!line_clipping(0, w, 0, h, x1, y1, x2, y2)) return;
+	if (!line_clipping(Xmin, Xmax, Ymin, Ymax, x1, y1, x2, y2)) return;
 
 	int dx = ABS(x2 - x1), sx = x1 < x2 ? 1 : -1;
 	int dy = ABS(y2 - y1), sy = y1 < y2 ? 1 : -1;
 	int err = (dx > dy ? dx : - dy) / 2;
 
 	while (1) {
-		m_setPixel(surface, pitch, w, h, x1, y1, color);
+		plot(x1, y1);
 		if (x1 == x2 && y1 == y2) break;
 		
 		int e2 = err;
@@ -135,6 +140,13 @@ void Rasterizer::bresenhamDrawLine(uint32_t* surface, int pitch, int w, int h, i
 	}
 }
 
+void Rasterizer::bresenhamDrawLine(uint32_t* surface, int pitch, int w, int h, int x1, int y1, int x2, int y2, uint32_t color)
+{
+	walkLine(0, w, 0, h, x1, y1, x2, y2, [&](int x, int y) {
+		m_setPixel(surface, pitch, w, h, x, y, color);
+	});
+}
+
 void Rasterizer::setPixel(uint32_t* surface, int pitch, int w, int h, int x, int y, uint32_t color)
 {
 	m_setPixel(surface, pitch, w, h, x, y, color);
@@ -172,33 +184,54 @@ static Eigen::Vector3f barycentricCoordinates(float x, float y, const Eigen::Vec
 	return { alpha, beta, gamma };
 }
 
+// Attributes are only interpolated for the fragment shader, depth has its own plane
+template <bool Enabled>
+static inline void stepAttributes(Eigen::VectorXf& attributes, const Eigen::VectorXf& step) {
+	if (Enabled)
+		attributes += step;
+}
+
+template <DepthFormat F, bool ZTest, DepthFunc Func, bool DepthWrite, bool PerspectiveCorrect, bool Sparse, bool ColorWrite>
 void Rasterizer::drawTriangleSample(SoftwareRenderer *renderer, RenderContext *ctx, Eigen::VectorXf vertices[3])
 {
+	using DepthType = typename DepthTraits<F>::Type;
+	constexpr int TILE_SIZE = DepthBuffer::TILE_SIZE;
 
 	auto pShader = renderer->pShader;
-	auto surface = renderer->frameBuffer;
-	auto pitch = renderer->pitch;
+	auto colorTarget = renderer->colorTarget;
+	auto &colorAddressing = renderer->colorAddressing;
+	const bool tiledColor = renderer->colorLayout == SurfaceLayout::TILED;
 	auto w = renderer->w;
 	auto h = renderer->h;
-	auto zBufferEnabled = renderer->zBufferEnabled;
-	auto pcEnabled = renderer->perspectiveCorrectEnabled;
+	auto &state = renderer->pipeline->getDesc();
+	auto format = renderer->format;
+	auto colorRow = renderer->colorRow.data();
+	auto colorRowMask = renderer->colorRowMask.data();
+	auto &depthBuffer = *renderer->zBuffer;
+	auto profiler = renderer->profiler && renderer->profiler->isCapturing() ? renderer->profiler.get() : nullptr;
 
 	assert(pShader != nullptr && "shader is null!");
 
 	auto &desc = pShader->getDesc();
+	// Shaders declaring their varyings only get the channels they read interpolated
+	const bool declaredVaryings = !desc.varyings.empty();
+	assert((!declaredVaryings || desc.varyings.size() == std::size_t(vertices[0].size()))
+		&& "One interpolation qualifier is needed per vertex output channel!");
 
 	Eigen::Vector3f points[3];
+	float infWs[3];
 
 	for (int i = 0; i < 3; ++i) {
 		// Do Clip (TODO: NOT IMPLEMENTED)
 
 		// Do Perspective Division
 		const float infW = 1 / vertices[i](desc.positionPlacement + 3); // the W
+		infWs[i] = infW;
 
 		// Do perspective division on all attributes 
 		// only when perspective correction is enabled.
 		// Otherwise, division is only be applied on position
-		if (pcEnabled)
+		if (PerspectiveCorrect && !declaredVaryings)
 			vertices[i] *= infW;
 		else
 			vertices[i].segment<4>(desc.positionPlacement) *= infW;
@@ -219,7 +252,7 @@ void Rasterizer::drawTriangleSample(SoftwareRenderer *renderer, RenderContext *c
 	const float CrossResult = (AB.x() * AC.y() - AC.x() * AB.y());
 	const bool isCCW = CrossResult > 0.0f;
 
-	if ((renderer->backfaceCull && (!isCCW)) || fabsf(CrossResult) < 0.01 ) {
+	if ((state.backfaceCull && (!isCCW)) || fabsf(CrossResult) < 0.01 ) {
 		// cull it out
 		return;
 	}
@@ -241,78 +274,251 @@ void Rasterizer::drawTriangleSample(SoftwareRenderer *renderer, RenderContext *c
 	aabb.x1 = std::min(aabb.x1, w);
 	aabb.y1 = std::min(aabb.y1, h);
 
+	// Interpolation always steps from the corner of the on-screen box, so a pixel gets the
+	// same values whatever the scissor rectangle is. Only the stepping covers the clipped part.
+	const auto &scissor = renderer->scissor;
+	const auto clip = decltype(aabb) {
+		std::max(aabb.x0, scissor.x0), std::max(aabb.y0, scissor.y0),
+		std::min(aabb.x1, scissor.x1), std::min(aabb.y1, scissor.y1),
+	};
+
+	// Layout of the bound pipeline and shader, see VaryingLayout
+	const auto &varyingLayout = renderer->varyingLayout;
+	const int scaleChannel = varyingLayout.scaleChannel;
+	Eigen::VectorXf* packedVertices = renderer->packedVertices;
+
+	if (ColorWrite && declaredVaryings) {
+		for (int i = 0; i < 3; ++i) {
+			packedVertices[i].resize(varyingLayout.packedSize);
+			for (const auto &run : varyingLayout.runs) {
+				if (run.perspective)
+					packedVertices[i].segment(run.packed, run.size) = vertices[i].segment(run.channel, run.size) * infWs[i];
+				else
+					packedVertices[i].segment(run.packed, run.size) = vertices[i].segment(run.channel, run.size);
+			}
+			if (scaleChannel >= 0)
+				packedVertices[i](scaleChannel) = infWs[i];
+		}
+	}
+
+	const Eigen::VectorXf* interpolated = declaredVaryings ? packedVertices : vertices;
+
 	Eigen::Vector3f cooAcc[2];
 	auto cooLine = barycentricCoordinates(aabb.x0 + 0.5f, aabb.y0 + 0.5f, points, cooAcc);
-	Eigen::VectorXf attrLine = vertices[0] * cooLine.x() + vertices[1] * cooLine.y() + vertices[2] * cooLine.z();
+	Eigen::VectorXf attrLine, attrXAcc, attrYAcc;
+	if (ColorWrite) {
+		attrLine = interpolated[0] * cooLine.x() + interpolated[1] * cooLine.y() + interpolated[2] * cooLine.z();
+		attrXAcc = cooAcc[0].x() * interpolated[0] + cooAcc[0].y() * interpolated[1] + cooAcc[0].z() * interpolated[2];
+		attrYAcc = cooAcc[1].x() * interpolated[0] + cooAcc[1].y() * interpolated[1] + cooAcc[1].z() * interpolated[2];
+	}
+
+	// Depth is interpolated on its own, z / w is already the reversed depth
+	const Eigen::Vector3f depths(points[0].z(), points[1].z(), points[2].z());
+
+	DepthBuffer::Plane depthPlane;
+	depthPlane.a = cooAcc[0].dot(depths);
+	depthPlane.b = cooAcc[1].dot(depths);
+	depthPlane.c = cooLine.dot(depths) - depthPlane.a * (aabb.x0 + 0.5f) - depthPlane.b * (aabb.y0 + 0.5f);
+
+	const int density = state.sampleDensity;
+	// Samples passing the depth test, added to the active occlusion query
+	uint64_t samplesPassed = 0;
+
+	// With tile compression, depth tiles fully covered by the triangle and entirely in front
+	// of their old content just take its plane. Every other tile touched gets expanded.
+	const uint8_t* acceptedTiles = nullptr;
+	int tileX0 = 0;
+	int tileY0 = 0;
+	int tilesAcross = 0;
+
+	if (ZTest && depthBuffer.tileCompression && clip.x0 < clip.x1 && clip.y0 < clip.y1) {
+		const bool acceptWholeTiles = !Sparse && DepthWrite && (!ColorWrite || !desc.usesDiscard);
+		// margin against the error accumulated by stepping barycentrics across the bounding box
+		constexpr float coverageMargin = 1e-3f;
+
+		tileX0 = clip.x0 / TILE_SIZE;
+		tileY0 = clip.y0 / TILE_SIZE;
+		tilesAcross = (clip.x1 - 1) / TILE_SIZE + 1 - tileX0;
+		const int tilesDown = (clip.y1 - 1) / TILE_SIZE + 1 - tileY0;
+
+		auto &accepted = renderer->acceptedTiles;
+		accepted.assign(std::size_t(tilesAcross) * tilesDown, 0);
+
+		for (int ty = tileY0; ty < tileY0 + tilesDown; ++ty) {
+			for (int tx = tileX0; tx < tileX0 + tilesAcross; ++tx) {
+				// Barycentrics at the outermost pixel centers of the tile
+				Eigen::Vector3f minCoo = Eigen::Vector3f::Constant(FLT_MAX);
+				Eigen::Vector3f maxCoo = Eigen::Vector3f::Constant(-FLT_MAX);
+
+				for (int corner = 0; corner < 4; ++corner) {
+					const int cx = tx * TILE_SIZE + (corner & 1) * (TILE_SIZE - 1);
+					const int cy = ty * TILE_SIZE + (corner >> 1) * (TILE_SIZE - 1);
+					const Eigen::Vector3f coo = cooLine + float(cx - aabb.x0) * cooAcc[0] + float(cy - aabb.y0) * cooAcc[1];
+					minCoo = minCoo.cwiseMin(coo);
+					maxCoo = maxCoo.cwiseMax(coo);
+				}
 
-	Eigen::VectorXf attrXAcc = cooAcc[0].x() * vertices[0] + cooAcc[0].y() * vertices[1] + cooAcc[0].z() * vertices[2];
-	Eigen::VectorXf attrYAcc = cooAcc[1].x() * vertices[0] + cooAcc[1].y() * vertices[1] + cooAcc[1].z() * vertices[2];
+				// tiles entirely outside one of the edges are left as they are
+				if (maxCoo.minCoeff() < -coverageMargin)
+					continue;
+
+				// the whole tile must also lie within the scissor rectangle
+				const bool inside = tx * TILE_SIZE >= clip.x0 && (tx + 1) * TILE_SIZE <= clip.x1
+					&& ty * TILE_SIZE >= clip.y0 && (ty + 1) * TILE_SIZE <= clip.y1;
+
+				uint8_t& tileAccepted = accepted[std::size_t(ty - tileY0) * tilesAcross + (tx - tileX0)];
+
+				if (Func == DepthFunc::EQUAL) {
+					// A depth prepass of this triangle left its exact plane, which passes on every covered pixel
+					if (depthBuffer.matchesPlane(tx, ty, depthPlane))
+						tileAccepted = 1;
+					else
+						depthBuffer.expandTile(tx, ty);
+				}
+				else if (acceptWholeTiles && inside && minCoo.minCoeff() > coverageMargin && depthBuffer.acceptPlane<F>(tx, ty, depthPlane))
+					tileAccepted = 1;
+				else
+					depthBuffer.expandTile(tx, ty);
+			}
+		}
+
+		acceptedTiles = accepted.data();
+	}
+
+	DepthType* depthData = depthBuffer.data<F>();
 
 	Eigen::VectorXf fixedAttr = vertices[0];
-	Eigen::VectorXf attrPixel = vertices[0];
+	Eigen::VectorXf attrPixel = interpolated[0];
 	Eigen::Vector3f cooPixel;
 	Eigen::Vector4f fcolor;
 
-	uint8_t color[4];
-	uint8_t density = renderer->sampleDensity;
+	bool discard = false;
+	ctx->discard = [&discard] () { discard = true; };
+
+	for (int y = aabb.y0; y < clip.y0; ++y) {
+		cooLine += cooAcc[1];
+		stepAttributes<ColorWrite>(attrLine, attrYAcc);
+	}
+
+	FrameProfiler::Clock::time_point rowStart;
 
-	for (int y = aabb.y0; y < aabb.y1; ++y) {
+	for (int y = clip.y0; y < clip.y1; ++y) {
 		cooPixel = cooLine;
-		attrPixel = attrLine;
-		for (int x = aabb.x0; x < aabb.x1; ++x) {
+		if (ColorWrite)
+			attrPixel = attrLine;
+
+		if (profiler)
+			rowStart = FrameProfiler::Clock::now();
+
+		for (int x = aabb.x0; x < clip.x0; ++x) {
+			cooPixel += cooAcc[0];
+			stepAttributes<ColorWrite>(attrPixel, attrXAcc);
+		}
+
+		DepthType* depthRow = depthData + depthBuffer.addressing.row(y);
+		const uint8_t* rowAcceptedTiles = acceptedTiles ?
+			acceptedTiles + std::size_t(y / TILE_SIZE - tileY0) * tilesAcross : nullptr;
+
+		// Range of the row which received colors
+		int spanBegin = clip.x1;
+		int spanEnd = clip.x0;
+
+		for (int x = clip.x0; x < clip.x1; ++x, cooPixel += cooAcc[0], stepAttributes<ColorWrite>(attrPixel, attrXAcc)) {
 
 			// discard fragment if not in density grid
-			if (!density || (x % (density + 1) == 0 && y % (density + 1) == 0)) {
-				if (cooPixel.x() > 0 && cooPixel.y() > 0 && cooPixel.z() > 0) {
-					const float infW = 1 / attrPixel(desc.positionPlacement + 3);
-					bool discard = false;
-					ctx->discard = [&] () { discard = true; };
-					if (pcEnabled) {
-						fixedAttr = attrPixel * infW;
-						pShader->fragmentShader(*ctx, fixedAttr, fcolor);
-					}
-					else {
-						pShader->fragmentShader(*ctx, attrPixel, fcolor);
-					}
-
-					if (!discard) {
-						fcolor(0) = std::min(fcolor(0), 1.0f);
-						fcolor(1) = std::min(fcolor(1), 1.0f);
-						fcolor(2) = std::min(fcolor(2), 1.0f);
-						fcolor(3) = std::min(fcolor(3), 1.0f);
-						fcolor *= 255;
-						color[0] = fcolor(2);
-						color[1] = fcolor(1);
-						color[2] = fcolor(0);
-						color[3] = fcolor(3);
-
-						float z = attrPixel(desc.positionPlacement + 2);
-						if (zBufferEnabled){
-							float& oldz = renderer->zBuffer[std::size_t(y) * w + x];
-							if (z > oldz) {
-								m_setPixel(surface, pitch, w, h, x, h - y - 1, *reinterpret_cast<uint32_t*>(color));
-								oldz = z;
-							}
-						}
-						else {
-							m_setPixel(surface, pitch, w, h, x, h - y - 1, *reinterpret_cast<uint32_t*>(color));
-						}
-					}
+			if (Sparse && (x % (density + 1) != 0 || y % (density + 1) != 0))
+				continue;
+
+			if (!(cooPixel.x() > 0 && cooPixel.y() > 0 && cooPixel.z() > 0))
+				continue;
+
+			// Early depth test, the depth is written once the fragment survives its shader
+			DepthType* depthTarget = nullptr;
+			DepthType depth = DepthType();
+
+			if (ZTest && !(rowAcceptedTiles && rowAcceptedTiles[x / TILE_SIZE - tileX0])) {
+				depth = DepthTraits<F>::encode(depthPlane.at(x, y));
+				depthTarget = depthRow + depthBuffer.addressing.column(x);
+				if (Func == DepthFunc::EQUAL ? !(depth == *depthTarget) : !(depth > *depthTarget))
+					continue;
+			}
+
+			// Without color writes the fragment shader does not run
+			if (!ColorWrite) {
+				if (DepthWrite && depthTarget)
+					*depthTarget = depth;
+				samplesPassed++;
+				continue;
+			}
+
+			if (profiler)
+				profiler->countFragment(x);
+
+			discard = false;
+			if (declaredVaryings) {
+				// FLAT and UNUSED channels of fixedAttr are never overwritten
+				const float scale = scaleChannel >= 0 ? 1 / attrPixel(scaleChannel) : 1.0f;
+				for (const auto &run : varyingLayout.runs) {
+					if (run.perspective)
+						fixedAttr.segment(run.channel, run.size) = attrPixel.segment(run.packed, run.size) * scale;
+					else
+						fixedAttr.segment(run.channel, run.size) = attrPixel.segment(run.packed, run.size);
 				}
+				pShader->fragmentShader(*ctx, fixedAttr, fcolor);
 			}
-			cooPixel += cooAcc[0];
-			attrPixel += attrXAcc;
+			else if (PerspectiveCorrect) {
+				const float infW = 1 / attrPixel(desc.positionPlacement + 3);
+				fixedAttr = attrPixel * infW;
+				pShader->fragmentShader(*ctx, fixedAttr, fcolor);
+			}
+			else {
+				pShader->fragmentShader(*ctx, attrPixel, fcolor);
+			}
+
+			if (discard)
+				continue;
+
+			if (DepthWrite && depthTarget)
+				*depthTarget = depth;
+			samplesPassed++;
+
+			Eigen::Map<Eigen::Vector4f>(colorRow + 4 * std::size_t(x)) = fcolor;
+			colorRowMask[x] = 1;
+			spanBegin = std::min(spanBegin, x);
+			spanEnd = x + 1;
 		}
+
+		if (spanBegin < spanEnd) {
+			// Tiled targets are contiguous only up to the end of a tile
+			uint8_t* row = colorTarget + colorAddressing.row(h - y - 1);
+			for (int x = spanBegin; x < spanEnd;) {
+				const int end = tiledColor ? std::min(spanEnd, (x | (TILE_SIZE - 1)) + 1) : spanEnd;
+				PixelPacker::packRow(format, colorRow + 4 * std::size_t(x), colorRowMask + x, row + colorAddressing.column(x), end - x);
+				x = end;
+			}
+			std::fill(colorRowMask + spanBegin, colorRowMask + spanEnd, 0);
+		}
+
+		if (profiler)
+			profiler->endRow(y, rowStart);
+
 		cooLine += cooAcc[1];
-		attrLine += attrYAcc;
+		stepAttributes<ColorWrite>(attrLine, attrYAcc);
 	}
+
+	if (renderer->activeQuery)
+		renderer->activeQuery->samplesPassed += samplesPassed;
 }
 
-void Rasterizer::drawTriangleWireframe(SoftwareRenderer *renderer, RenderContext *ctx, Eigen::VectorXf vertices[3])
+void Rasterizer::drawTriangleWireframe(SoftwareRenderer *renderer, RenderContext *, Eigen::VectorXf vertices[3])
 {
+	auto &state = renderer->pipeline->getDesc();
+	if (!state.colorWrite)
+		return;
+
 	auto pShader = renderer->pShader;
-	auto surface = renderer->frameBuffer;
-	auto pitch = renderer->pitch;
+	auto colorTarget = renderer->colorTarget;
+	auto &colorAddressing = renderer->colorAddressing;
 	auto w = renderer->w;
 	auto h = renderer->h;
 
@@ -337,12 +543,79 @@ void Rasterizer::drawTriangleWireframe(SoftwareRenderer *renderer, RenderContext
 
 	bool isCCW = (AB.x() * AC.y() - AC.x() * AB.y()) > 0;
 
-	if (renderer->backfaceCull && (!isCCW)) {
+	if (state.backfaceCull && (!isCCW)) {
 		// cull it out
 		return;
 	}
 
-	bresenhamDrawLine(surface, pitch, w, h, points[0][0], h - points[0][1], points[1][0], h - points[1][1], 0xFFFFFFFF);
-	bresenhamDrawLine(surface, pitch, w, h, points[1][0], h - points[1][1], points[2][0], h - points[2][1], 0xFFFFFFFF);
-	bresenhamDrawLine(surface, pitch, w, h, points[0][0], h - points[0][1], points[2][0], h - points[2][1], 0xFFFFFFFF);
+	const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	uint8_t color[4 * sizeof(float)];
+	PixelPacker::packColor(renderer->format, white, color);
+
+	const auto bpp = PixelPacker::bytesPerPixel(renderer->format);
+	auto plot = [&](int x, int y) {
+		std::memcpy(colorTarget + colorAddressing.row(y) + colorAddressing.column(x), color, bpp);
+	};
+
+	// Lines are clipped to the scissor rectangle, flipped to surface coordinates
+	const auto &scissor = renderer->scissor;
+	const int clipX0 = scissor.x0, clipX1 = scissor.x1;
+	const int clipY0 = h - scissor.y1, clipY1 = h - scissor.y0;
+
+	walkLine(clipX0, clipX1, clipY0, clipY1, points[0][0], h - points[0][1], points[1][0], h - points[1][1], plot);
+	walkLine(clipX0, clipX1, clipY0, clipY1, points[1][0], h - points[1][1], points[2][0], h - points[2][1], plot);
+	walkLine(clipX0, clipX1, clipY0, clipY1, points[0][0], h - points[0][1], points[2][0], h - points[2][1], plot);
+}
+
+template <DepthFormat F, bool ZTest, DepthFunc Func, bool DepthWrite>
+PipelineState::RasterKernel Rasterizer::selectKernelVariant(bool colorWrite, bool perspectiveCorrect, bool sparse)
+{
+	// Perspective correction only matters to the fragment shader, which does not run without color writes
+	if (!colorWrite) {
+		static const PipelineState::RasterKernel kernels[2] = {
+			&drawTriangleSample<F, ZTest, Func, DepthWrite, false, false, false>,
+			&drawTriangleSample<F, ZTest, Func, DepthWrite, false, true, false>,
+		};
+		return kernels[sparse];
+	}
+
+	static const PipelineState::RasterKernel kernels[2][2] = {
+		{ &drawTriangleSample<F, ZTest, Func, DepthWrite, false, false, true>, &drawTriangleSample<F, ZTest, Func, DepthWrite, false, true, true> },
+		{ &drawTriangleSample<F, ZTest, Func, DepthWrite, true, false, true>,  &drawTriangleSample<F, ZTest, Func, DepthWrite, true, true, true> },
+	};
+	return kernels[perspectiveCorrect][sparse];
+}
+
+template <DepthFormat F>
+PipelineState::RasterKernel Rasterizer::selectDepthTestKernel(const PipelineStateDesc& desc)
+{
+	const bool pc = desc.perspectiveCorrect;
+	const bool sparse = desc.sampleDensity != 0;
+
+	switch (desc.depthFunc) {
+	case DepthFunc::GREATER:
+		return desc.depthWrite ? selectKernelVariant<F, true, DepthFunc::GREATER, true>(desc.colorWrite, pc, sparse)
+			: selectKernelVariant<F, true, DepthFunc::GREATER, false>(desc.colorWrite, pc, sparse);
+	case DepthFunc::EQUAL:
+		return desc.depthWrite ? selectKernelVariant<F, true, DepthFunc::EQUAL, true>(desc.colorWrite, pc, sparse)
+			: selectKernelVariant<F, true, DepthFunc::EQUAL, false>(desc.colorWrite, pc, sparse);
+	}
+	return nullptr;
+}
+
+PipelineState::RasterKernel Rasterizer::selectKernel(const PipelineStateDesc& desc)
+{
+	if (desc.drawStyle == DrawStyle::TRIANGLES_WIREFRAME)
+		return &drawTriangleWireframe;
+
+	if (desc.zBufferEnabled) {
+		switch (desc.depthFormat) {
+		case DepthFormat::FLOAT32: return selectDepthTestKernel<DepthFormat::FLOAT32>(desc);
+		case DepthFormat::UNORM24: return selectDepthTestKernel<DepthFormat::UNORM24>(desc);
+		case DepthFormat::UNORM16: return selectDepthTestKernel<DepthFormat::UNORM16>(desc);
+		}
+	}
+
+	// Neither the depth format, function nor write matter without depth test
+	return selectKernelVariant<DepthFormat::FLOAT32, false, DepthFunc::GREATER, false>(desc.colorWrite, desc.perspectiveCorrect, desc.sampleDensity != 0);
 }
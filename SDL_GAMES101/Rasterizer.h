@@ -3,15 +3,27 @@
 #include <cstdint>
 #include <eigen3/Eigen/Eigen>
 #include "RenderContext.h"
+#include "DepthBuffer.h"
+#include "PipelineState.h"
 
 class SoftwareRenderer;
 
 class Rasterizer
 {
+	template <DepthFormat F, bool ZTest, DepthFunc Func, bool DepthWrite, bool PerspectiveCorrect, bool Sparse, bool ColorWrite>
+	static void drawTriangleSample(SoftwareRenderer *renderer, RenderContext *ctx, Eigen::VectorXf vertices[3]);
+
+	template <DepthFormat F, bool ZTest, DepthFunc Func, bool DepthWrite>
+	static PipelineState::RasterKernel selectKernelVariant(bool colorWrite, bool perspectiveCorrect, bool sparse);
+
+	template <DepthFormat F>
+	static PipelineState::RasterKernel selectDepthTestKernel(const PipelineStateDesc& desc);
+
 public:
 	static void bresenhamDrawLine(uint32_t* surface, int pitch, int w, int h, int x1, int y1, int x2, int y2, uint32_t color);
 	static void setPixel(uint32_t* surface, int pitch, int w, int h, int x, int y, uint32_t color);
-	static void drawTriangleSample(SoftwareRenderer *renderer, RenderContext *ctx, Eigen::VectorXf vertices[3]);
 	static void drawTriangleWireframe(SoftwareRenderer *renderer, RenderContext *ctx, Eigen::VectorXf vertices[3]);
+
+	static PipelineState::RasterKernel selectKernel(const PipelineStateDesc& desc);
 };
 
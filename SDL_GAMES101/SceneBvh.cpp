@@ -0,0 +1,173 @@
+#include "SceneBvh.h"
+#include <cassert>
+#include <algorithm>
+
+SceneBvh::ObjectId SceneBvh::insert(const Aabb& bounds)
+{
+	ObjectId id;
+	if (!freeIds.empty()) {
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else {
+		id = static_cast<ObjectId>(objects.size());
+		objects.emplace_back();
+	}
+
+	objects[id] = { bounds, 0, true };
+	objectCount++;
+	structureDirty = true;
+	return id;
+}
+
+void SceneBvh::remove(ObjectId object)
+{
+	assert(object < objects.size() && objects[object].alive && "Invalid scene object!");
+
+	objects[object].alive = false;
+	freeIds.push_back(object);
+	objectCount--;
+	structureDirty = true;
+}
+
+void SceneBvh::update(ObjectId object, const Aabb& bounds)
+{
+	assert(object < objects.size() && objects[object].alive && "Invalid scene object!");
+
+	Object& target = objects[object];
+	if (target.bounds == bounds)
+		return;
+
+	target.bounds = bounds;
+	if (!structureDirty)
+		refitUpwards(target.leaf);
+}
+
+void SceneBvh::refitUpwards(uint32_t node)
+{
+	for (;;) {
+		Node& current = nodes[node];
+
+		Aabb bounds = Aabb::empty();
+		if (current.children == 0) {
+			for (uint32_t i = current.first; i < current.first + current.count; ++i)
+				bounds = bounds.united(objects[leafObjects[i]].bounds);
+		}
+		else {
+			bounds = nodes[current.children].bounds.united(nodes[current.children + 1].bounds);
+		}
+
+		// Ancestors only change when this node did
+		if (bounds == current.bounds)
+			return;
+
+		refitCost += bounds.surfaceArea() - current.bounds.surfaceArea();
+		current.bounds = bounds;
+
+		if (node == 0)
+			return;
+		node = current.parent;
+	}
+}
+
+void SceneBvh::rebuild()
+{
+	nodes.clear();
+	leafObjects.clear();
+
+	for (ObjectId id = 0; id < objects.size(); ++id) {
+		if (objects[id].alive)
+			leafObjects.push_back(id);
+	}
+
+	structureDirty = false;
+	if (leafObjects.empty()) {
+		builtCost = refitCost = 0.0f;
+		return;
+	}
+
+	nodes.reserve(2 * leafObjects.size() / MAX_LEAF_OBJECTS + 1);
+	nodes.emplace_back();
+	buildNode(0, 0, leafObjects.size());
+
+	builtCost = 0.0f;
+	for (const Node& node : nodes)
+		builtCost += node.bounds.surfaceArea();
+	refitCost = builtCost;
+}
+
+uint32_t SceneBvh::buildNode(uint32_t index, std::size_t begin, std::size_t end)
+{
+	Aabb bounds = Aabb::empty();
+	Aabb centers = Aabb::empty();
+	for (std::size_t i = begin; i < end; ++i) {
+		const Aabb& objectBounds = objects[leafObjects[i]].bounds;
+		bounds = bounds.united(objectBounds);
+		centers = centers.united({ objectBounds.center(), objectBounds.center() });
+	}
+	nodes[index].bounds = bounds;
+	nodes[index].first = static_cast<uint32_t>(begin);
+	nodes[index].count = static_cast<uint32_t>(end - begin);
+
+	if (end - begin <= MAX_LEAF_OBJECTS) {
+		nodes[index].children = 0;
+		for (std::size_t i = begin; i < end; ++i)
+			objects[leafObjects[i]].leaf = index;
+		return index;
+	}
+
+	// Median split along the longest extent of the object centers
+	int axis;
+	(centers.upper - centers.lower).maxCoeff(&axis);
+	const std::size_t middle = (begin + end) / 2;
+	std::nth_element(leafObjects.begin() + begin, leafObjects.begin() + middle, leafObjects.begin() + end,
+		[&](ObjectId a, ObjectId b) { return objects[a].bounds.center()[axis] < objects[b].bounds.center()[axis]; });
+
+	// Siblings are allocated together, so a node only stores its first child
+	const uint32_t children = static_cast<uint32_t>(nodes.size());
+	nodes.resize(nodes.size() + 2);
+	nodes[index].children = children;
+	nodes[children].parent = index;
+	nodes[children + 1].parent = index;
+
+	buildNode(children, begin, middle);
+	buildNode(children + 1, middle, end);
+	return index;
+}
+
+void SceneBvh::cull(const Frustum& frustum, std::vector<ObjectId>& visible)
+{
+	if (structureDirty || refitCost > builtCost * rebuildThreshold)
+		rebuild();
+	if (nodes.empty())
+		return;
+
+	std::vector<uint32_t> stack;
+	stack.push_back(0);
+
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		const Frustum::Result result = frustum.test(node.bounds);
+		if (result == Frustum::Result::OUTSIDE)
+			continue;
+
+		if (result == Frustum::Result::INSIDE) {
+			visible.insert(visible.end(), leafObjects.begin() + node.first, leafObjects.begin() + node.first + node.count);
+			continue;
+		}
+
+		if (node.children != 0) {
+			stack.push_back(node.children + 1);
+			stack.push_back(node.children);
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+			const ObjectId object = leafObjects[i];
+			if (node.count == 1 || frustum.intersects(objects[object].bounds))
+				visible.push_back(object);
+		}
+	}
+}
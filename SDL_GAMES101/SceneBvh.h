@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "Frustum.h"
+
+// Bounding volume hierarchy over the world bounds of scene objects, culled against view frustums.
+// Moving objects refit the nodes above them; the tree is rebuilt once refits have
+// degraded it, or after objects were added or removed.
+class SceneBvh
+{
+public:
+	using ObjectId = uint32_t;
+
+	static constexpr ObjectId INVALID_OBJECT = ~ObjectId(0);
+	static constexpr int MAX_LEAF_OBJECTS = 4;
+
+private:
+	struct Node {
+		Aabb bounds;
+		uint32_t parent;
+		// First of the two children of inner nodes, 0 for leaves
+		uint32_t children;
+		// Range of `leafObjects` under the node. Builds partition it in place, so every subtree is contiguous.
+		uint32_t first;
+		uint32_t count;
+	};
+
+	struct Object {
+		Aabb bounds;
+		uint32_t leaf;
+		bool alive;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Object> objects;
+	std::vector<ObjectId> leafObjects;
+	std::vector<ObjectId> freeIds;
+	std::size_t objectCount = 0;
+
+	bool structureDirty = false;
+	// Sum of the node surface areas, which grows as refits loosen the tree
+	float builtCost = 0.0f;
+	float refitCost = 0.0f;
+
+	uint32_t buildNode(uint32_t parent, std::size_t begin, std::size_t end);
+	void refitUpwards(uint32_t node);
+
+public:
+	// Trees looser than this many times their cost when built are rebuilt on the next cull
+	float rebuildThreshold = 2.0f;
+
+	ObjectId insert(const Aabb& bounds);
+	void remove(ObjectId object);
+	void update(ObjectId object, const Aabb& bounds);
+	const Aabb& getBounds(ObjectId object) const noexcept { return objects[object].bounds; }
+	std::size_t size() const noexcept { return objectCount; }
+
+	void rebuild();
+
+	// Appends the objects whose bounds intersect the frustum. Subtrees entirely inside or
+	// outside it are not descended into, those inside append their objects in one go.
+	void cull(const Frustum& frustum, std::vector<ObjectId>& visible);
+};
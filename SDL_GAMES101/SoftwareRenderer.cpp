@@ -2,16 +2,123 @@
 #include "Rasterizer.h"
 #include "RenderContext.h"
 #include <memory>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 
-SoftwareRenderer::SoftwareRenderer(uint32_t* frameBuffer, int w, int h, int pitch): frameBuffer(frameBuffer), w(w), h(h), pitch(pitch)
+static uint64_t hashBytes(const void* data, std::size_t size, uint64_t hash)
 {
-	zBuffer.resize(std::size_t(w) * h);
-	clearZBuffer();
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+	constexpr uint64_t prime = 0x100000001B3ull;
+
+	std::size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 32;
+	}
+	for (; i < size; ++i)
+		hash = (hash ^ bytes[i]) * prime;
+
+	return hash;
+}
+
+template <typename T>
+static uint64_t hashValue(const T& value, uint64_t hash)
+{
+	return hashBytes(&value, sizeof(value), hash);
+}
+
+static uint64_t hashPipelineDesc(const PipelineStateDesc& desc, uint64_t hash)
+{
+	// field by field, the struct has padding
+	hash = hashValue(static_cast<int>(desc.drawStyle), hash);
+	hash = hashValue(desc.backfaceCull, hash);
+	hash = hashValue(desc.sampleDensity, hash);
+	hash = hashValue(desc.zBufferEnabled, hash);
+	hash = hashValue(static_cast<int>(desc.depthFormat), hash);
+	hash = hashValue(static_cast<int>(desc.depthFunc), hash);
+	hash = hashValue(desc.perspectiveCorrect, hash);
+	hash = hashValue(desc.colorWrite, hash);
+	hash = hashValue(desc.depthWrite, hash);
+	return hash;
+}
+
+static bool samePipelineDesc(const PipelineStateDesc& a, const PipelineStateDesc& b)
+{
+	return a.drawStyle == b.drawStyle && a.backfaceCull == b.backfaceCull && a.sampleDensity == b.sampleDensity &&
+		a.zBufferEnabled == b.zBufferEnabled && a.depthFormat == b.depthFormat && a.depthFunc == b.depthFunc &&
+		a.perspectiveCorrect == b.perspectiveCorrect && a.colorWrite == b.colorWrite && a.depthWrite == b.depthWrite;
+}
+
+// Copy a rectangle between a tiled surface and a linear one, in surface coordinates. Spans are split at tile
+// edges; with the pixel size known, the whole tile spans in the middle compile to a few vector moves.
+template <std::size_t Bpp, bool ToTiled>
+static void copyTiledRect(uint8_t* tiled, const SurfaceAddressing& addressing, uint8_t* linear, std::size_t pitch,
+	int x0, int y0, int x1, int y1)
+{
+	constexpr int TILE_SIZE = SurfaceAddressing::TILE_SIZE;
+
+	auto copy = [](uint8_t* tiledSpan, uint8_t* linearSpan, std::size_t bytes) {
+		if (ToTiled)
+			std::memcpy(tiledSpan, linearSpan, bytes);
+		else
+			std::memcpy(linearSpan, tiledSpan, bytes);
+	};
+
+	const int alignedX0 = std::min((x0 + TILE_SIZE - 1) & ~(TILE_SIZE - 1), x1);
+	const int alignedX1 = std::max(x1 & ~(TILE_SIZE - 1), alignedX0);
+
+	for (int y = y0; y < y1; ++y) {
+		uint8_t* tiledRow = tiled + addressing.row(y);
+		uint8_t* linearRow = linear + std::size_t(y) * pitch;
+
+		if (x0 < alignedX0)
+			copy(tiledRow + addressing.column(x0), linearRow + x0 * Bpp, std::size_t(alignedX0 - x0) * Bpp);
+		for (int x = alignedX0; x < alignedX1; x += TILE_SIZE)
+			copy(tiledRow + addressing.column(x), linearRow + x * Bpp, TILE_SIZE * Bpp);
+		if (alignedX1 < x1)
+			copy(tiledRow + addressing.column(alignedX1), linearRow + alignedX1 * Bpp, std::size_t(x1 - alignedX1) * Bpp);
+	}
+}
+
+template <bool ToTiled>
+static void copyTiledRect(PixelFormat format, uint8_t* tiled, const SurfaceAddressing& addressing, uint8_t* linear,
+	std::size_t pitch, int x0, int y0, int x1, int y1)
+{
+	switch (PixelPacker::bytesPerPixel(format)) {
+	case 2:		copyTiledRect<2, ToTiled>(tiled, addressing, linear, pitch, x0, y0, x1, y1); break;
+	case 4:		copyTiledRect<4, ToTiled>(tiled, addressing, linear, pitch, x0, y0, x1, y1); break;
+	case 16:	copyTiledRect<16, ToTiled>(tiled, addressing, linear, pitch, x0, y0, x1, y1); break;
+	default:	assert(false && "Unsupported pixel size!"); break;
+	}
+}
+
+// Vertex shaders read floats: vertices stored in a compressed layout are decoded to `scratch` first
+static inline const void* vertexInput(const IShader::ShaderDescriptor& desc, const uint8_t* vertex, float* scratch) noexcept
+{
+	if (!desc.inputLayout)
+		return vertex;
+
+	desc.inputLayout->decode(vertex, scratch);
+	return scratch;
+}
+
+SoftwareRenderer::SoftwareRenderer(void* frameBuffer, int w, int h, int pitch, PixelFormat format):
+	frameBuffer(reinterpret_cast<uint8_t*>(frameBuffer)), w(w), h(h), pitch(pitch), format(format)
+{
+	zBuffer = std::make_shared<DepthBuffer>(w, h);
+	updateColorTarget();
+	colorRow.resize(std::size_t(w) * 4);
+	colorRowMask.resize(w, 0);
+	scissor = { 0, 0, w, h };
 }
 
 void SoftwareRenderer::bindShader(IShader* pShader)
 {
 	this->pShader = pShader;
+	varyingLayoutDirty = true;
 }
 
 void SoftwareRenderer::setVertexArray(const void* vertexArray, std::size_t size)
@@ -20,46 +127,290 @@ void SoftwareRenderer::setVertexArray(const void* vertexArray, std::size_t size)
 	this->vertexArrayLength = size;
 }
 
+void SoftwareRenderer::bindPipelineState(std::shared_ptr<const PipelineState> pipeline)
+{
+	assert(pipeline != nullptr && "Pipeline state is null!");
+	this->pipeline = std::move(pipeline);
+	pipelineDesc = this->pipeline->getDesc();
+	pipelineDirty = false;
+	varyingLayoutDirty = true;
+}
+
 void SoftwareRenderer::setDrawStyle(DrawStyle drawStyle)
 {
-	this->drawStyle = drawStyle;
+	pipelineDesc.drawStyle = drawStyle;
+	pipelineDirty = true;
 }
 
 void SoftwareRenderer::setBackfaceCull(bool enable)
 {
-	backfaceCull = enable;
+	pipelineDesc.backfaceCull = enable;
+	pipelineDirty = true;
 }
 
 void SoftwareRenderer::setSampleDensity(uint8_t density)
 {
-	sampleDensity = density;
+	pipelineDesc.sampleDensity = density;
+	pipelineDirty = true;
 }
 
 void SoftwareRenderer::setZBufferEnabled(bool enable)
 {
-	zBufferEnabled = enable;
+	pipelineDesc.zBufferEnabled = enable;
+	pipelineDirty = true;
 }
 
 void SoftwareRenderer::setPerspectiveCorrect(bool enable)
 {
-	perspectiveCorrectEnabled = enable;
+	pipelineDesc.perspectiveCorrect = enable;
+	pipelineDirty = true;
+}
+
+void SoftwareRenderer::setDepthFunc(DepthFunc func)
+{
+	pipelineDesc.depthFunc = func;
+	pipelineDirty = true;
+}
+
+void SoftwareRenderer::setColorWrite(bool enable)
+{
+	pipelineDesc.colorWrite = enable;
+	pipelineDirty = true;
+}
+
+void SoftwareRenderer::setDepthWrite(bool enable)
+{
+	pipelineDesc.depthWrite = enable;
+	pipelineDirty = true;
+}
+
+void SoftwareRenderer::setClearColor(const Eigen::Vector4f& color)
+{
+	if (Eigen::Vector4f::Map(clearColor) == color)
+		return;
+
+	Eigen::Vector4f::Map(clearColor) = color;
+
+	if (capture)
+		capture->recordClearColor(clearColor);
+
+	// Regions skipped by the next frame would keep the old background
+	invalidateFrame();
+}
+
+void SoftwareRenderer::clear()
+{
+	assert(!frameActive && "Frames clear the regions they redraw by themselves!");
+
+	if (capture)
+		capture->recordOp(CaptureOp::CLEAR);
+
+	clearRect({ 0, 0, w, h });
+	zBuffer->clear();
 }
 
 void SoftwareRenderer::clearZBuffer()
 {
-	std::fill(zBuffer.begin(), zBuffer.end(), -1);
+	if (capture)
+		capture->recordOp(CaptureOp::CLEAR_ZBUFFER);
+
+	if (frameActive) {
+		recordCommand(FrameCommand::Type::CLEAR_DEPTH, nullptr, 0);
+		return;
+	}
+	zBuffer->clear();
+}
+
+void SoftwareRenderer::setDepthBuffer(std::shared_ptr<DepthBuffer> depthBuffer)
+{
+	assert(depthBuffer && depthBuffer->getWidth() == w && depthBuffer->getHeight() == h && "Depth buffer size mismatch!");
+	zBuffer = std::move(depthBuffer);
+
+	if (capture)
+		capture->recordDepthBuffer(zBuffer->getFormat(), zBuffer->isTileCompressionEnabled(), zBuffer->getLayout());
+
+	if (pipelineDesc.depthFormat != zBuffer->getFormat()) {
+		pipelineDesc.depthFormat = zBuffer->getFormat();
+		pipelineDirty = true;
+	}
 }
 
-std::vector<float>& SoftwareRenderer::getZbuffer()
+std::shared_ptr<DepthBuffer> SoftwareRenderer::getDepthBuffer()
 {
 	return zBuffer;
 }
 
+PixelFormat SoftwareRenderer::getPixelFormat() const
+{
+	return format;
+}
+
+void SoftwareRenderer::setProfiler(std::shared_ptr<FrameProfiler> profiler)
+{
+	assert((!profiler || (profiler->getWidth() >= w && profiler->getHeight() >= h)) && "Profiler is smaller than the target!");
+	this->profiler = std::move(profiler);
+}
+
+std::shared_ptr<FrameProfiler> SoftwareRenderer::getProfiler()
+{
+	return profiler;
+}
+
+void SoftwareRenderer::setRenderTarget(void* frameBuffer, int w, int h, int pitch)
+{
+	assert(!frameActive && "Render targets change between frames!");
+	assert(!capture && "Captures are recorded at a single size!");
+	assert((!profiler || (profiler->getWidth() >= w && profiler->getHeight() >= h)) && "Profiler is smaller than the target!");
+
+	this->frameBuffer = reinterpret_cast<uint8_t*>(frameBuffer);
+	this->pitch = pitch;
+
+	if (w != this->w || h != this->h) {
+		this->w = w;
+		this->h = h;
+		zBuffer = std::make_shared<DepthBuffer>(w, h, zBuffer->getFormat(), zBuffer->isTileCompressionEnabled(), zBuffer->getLayout());
+		colorRow.resize(std::size_t(w) * 4);
+		colorRowMask.assign(w, 0);
+		scissor = { 0, 0, w, h };
+	}
+	updateColorTarget();
+
+	// Bounds of the previous frame are in the pixels of the previous target
+	lastFrameCommands.clear();
+	lastFrameConstants.clear();
+	invalidateFrame();
+}
+
+bool SoftwareRenderer::startCapture(const char* path, int frames)
+{
+	assert(!frameActive && "Captures start between frames!");
+
+	auto writer = std::make_unique<CaptureWriter>();
+	if (!writer->open(path, w, h, format, frames))
+		return false;
+
+	writer->recordDepthBuffer(zBuffer->getFormat(), zBuffer->isTileCompressionEnabled(), zBuffer->getLayout());
+	writer->recordColorLayout(colorLayout);
+	writer->recordClearColor(clearColor);
+	capture = std::move(writer);
+
+	invalidateFrame();
+	return true;
+}
+
+void SoftwareRenderer::setColorLayout(SurfaceLayout layout)
+{
+	assert(!frameActive && "Layouts change between frames!");
+	colorLayout = layout;
+	updateColorTarget();
+
+	if (capture)
+		capture->recordColorLayout(layout);
+
+	// The tiled copy does not hold the previous image
+	invalidateFrame();
+}
+
+void SoftwareRenderer::updateColorTarget()
+{
+	const std::size_t bpp = PixelPacker::bytesPerPixel(format);
+
+	if (colorLayout == SurfaceLayout::TILED) {
+		tiledColor.resize(SurfaceAddressing::tiledSize(w, h, bpp));
+		colorTarget = tiledColor.data();
+	}
+	else {
+		tiledColor.clear();
+		tiledColor.shrink_to_fit();
+		colorTarget = frameBuffer;
+	}
+	colorAddressing = SurfaceAddressing(colorLayout, w, pitch, bpp);
+}
+
+void SoftwareRenderer::resolve()
+{
+	if (capture)
+		capture->recordOp(CaptureOp::RESOLVE);
+
+	resolveRect({ 0, 0, w, h });
+}
+
+void SoftwareRenderer::resolveRect(const Rect& rect)
+{
+	if (colorLayout != SurfaceLayout::TILED || rect.empty())
+		return;
+
+	copyTiledRect<false>(format, colorTarget, colorAddressing, frameBuffer, pitch, rect.x0, h - rect.y1, rect.x1, h - rect.y0);
+}
+
+std::shared_ptr<const PipelineState> SoftwareRenderer::getPipelineState()
+{
+	if (pipelineDirty) {
+		pipeline = PipelineState::create(pipelineDesc);
+		pipelineDirty = false;
+		varyingLayoutDirty = true;
+	}
+	return pipeline;
+}
+
+void SoftwareRenderer::updateVaryingLayout()
+{
+	if (!varyingLayoutDirty)
+		return;
+
+	varyingLayout = pipeline->buildVaryingLayout(pShader->getDesc());
+	varyingLayoutDirty = false;
+}
+
+void SoftwareRenderer::beginQuery(OcclusionQuery* query)
+{
+	assert(query && !activeQuery && "Invalid or nested occlusion query!");
+	assert(!frameActive && "Occlusion queries are not available inside frames!");
+	query->samplesPassed = 0;
+	activeQuery = query;
+}
+
+void SoftwareRenderer::endQuery()
+{
+	assert(activeQuery && "No occlusion query to end!");
+	activeQuery = nullptr;
+}
+
+void SoftwareRenderer::beginConditionalRender(const OcclusionQuery* query)
+{
+	assert(query && !renderCondition && "Invalid or nested conditional rendering!");
+	renderCondition = query;
+}
+
+void SoftwareRenderer::endConditionalRender()
+{
+	assert(renderCondition && "No conditional rendering to end!");
+	renderCondition = nullptr;
+}
+
 void SoftwareRenderer::draw()
 {
 	assert(this->pShader != nullptr && "No valid shader is bond!");
 
-	std::size_t inputElemSize = pShader->getDesc().inputVertexSize;
+	if (renderCondition && !renderCondition->anySamplesPassed() && !frameReplaying)
+		return;
+
+	if (capture && !frameReplaying)
+		capture->recordDraw(pShader, getPipelineState()->getDesc(), pVertexArray, vertexArrayLength, nullptr, 0);
+
+	if (frameActive) {
+		recordCommand(FrameCommand::Type::DRAW, nullptr, vertexArrayLength);
+		return;
+	}
+
+	const auto rasterKernel = getPipelineState()->getKernel();
+	assert((!pipeline->getDesc().zBufferEnabled || pipeline->getDesc().depthFormat == zBuffer->getFormat())
+		&& "Pipeline depth format does not match the depth buffer!");
+	updateVaryingLayout();
+
+	const auto& shaderDesc = pShader->getDesc();
+	std::size_t inputElemSize = shaderDesc.inputVertexSize;
+	float* decodedVertex = reserveDecodedVertex(shaderDesc);
 
 	const uint8_t* inputElems = reinterpret_cast<const uint8_t *>(pVertexArray);
 
@@ -68,28 +419,61 @@ void SoftwareRenderer::draw()
 	RenderContext ctx;
 	ctx.renderer = this;
 
+	FrameProfiler* const activeProfiler = profiler && profiler->isCapturing() ? profiler.get() : nullptr;
+	FrameProfiler::Scope scope(activeProfiler, "draw", "draw");
+	FrameProfiler::Clock::duration vertexTime{}, rasterTime{};
+	FrameProfiler::Clock::time_point start, shaded;
+
 	for (std::size_t i = 0; i < vertexArrayLength; i += 3) {
+		if (activeProfiler)
+			start = FrameProfiler::Clock::now();
+
 		for (std::size_t j = 0; j < 3; ++j) {
-			auto inputVertexData = reinterpret_cast<const void*>(inputElems + (i + j) * inputElemSize);
+			auto inputVertexData = vertexInput(shaderDesc, inputElems + (i + j) * inputElemSize, decodedVertex);
 
 			ctx.vertexID = i + j;
 			pShader->vertexShader(ctx, inputVertexData, outputElems[j]);
 		}
 
-		if (drawStyle == DrawStyle::TRIANGLES)
-			Rasterizer::drawTriangleSample(this, &ctx, outputElems);
-		else if (drawStyle == DrawStyle::TRIANGLES_WIREFRAME)
-			Rasterizer::drawTriangleWireframe(this, &ctx, outputElems);
+		if (activeProfiler)
+			shaded = FrameProfiler::Clock::now();
+
+		rasterKernel(this, &ctx, outputElems);
+
+		if (activeProfiler) {
+			vertexTime += shaded - start;
+			rasterTime += FrameProfiler::Clock::now() - shaded;
+		}
 
 		ctx.primitiveID = i / 3;
 	}
+
+	addDrawArgs(scope, vertexArrayLength / 3, vertexTime, rasterTime);
 }
 
 void SoftwareRenderer::drawIndexed(const uint32_t* indices, std::size_t size)
 {
 	assert(this->pShader != nullptr && "No valid shader is bond!");
 
-	std::size_t inputElemSize = pShader->getDesc().inputVertexSize;
+	if (renderCondition && !renderCondition->anySamplesPassed() && !frameReplaying)
+		return;
+
+	if (capture && !frameReplaying)
+		capture->recordDraw(pShader, getPipelineState()->getDesc(), pVertexArray, vertexArrayLength, indices, size);
+
+	if (frameActive) {
+		recordCommand(FrameCommand::Type::DRAW, indices, size);
+		return;
+	}
+
+	const auto rasterKernel = getPipelineState()->getKernel();
+	assert((!pipeline->getDesc().zBufferEnabled || pipeline->getDesc().depthFormat == zBuffer->getFormat())
+		&& "Pipeline depth format does not match the depth buffer!");
+	updateVaryingLayout();
+
+	const auto& shaderDesc = pShader->getDesc();
+	std::size_t inputElemSize = shaderDesc.inputVertexSize;
+	float* decodedVertex = reserveDecodedVertex(shaderDesc);
 
 	const uint8_t* inputElems = reinterpret_cast<const uint8_t *>(pVertexArray);
 
@@ -99,22 +483,507 @@ void SoftwareRenderer::drawIndexed(const uint32_t* indices, std::size_t size)
 	ctx.renderer = this;
 
 
+	FrameProfiler* const activeProfiler = profiler && profiler->isCapturing() ? profiler.get() : nullptr;
+	FrameProfiler::Scope scope(activeProfiler, "drawIndexed", "draw");
+	FrameProfiler::Clock::duration vertexTime{}, rasterTime{};
+	FrameProfiler::Clock::time_point start, shaded;
+
 	for (std::size_t i = 0; i < size; i += 3) {
+		if (activeProfiler)
+			start = FrameProfiler::Clock::now();
+
 		for (std::size_t j = 0; j < 3; ++j) {
 			std::size_t index = indices[i + j];
 			assert(index < vertexArrayLength && "Vertex array out of index!");
 
-			auto inputVertexData = reinterpret_cast<const void*>(inputElems + index * inputElemSize);
+			auto inputVertexData = vertexInput(shaderDesc, inputElems + index * inputElemSize, decodedVertex);
 			ctx.vertexID = i + j;
 			pShader->vertexShader(ctx, inputVertexData, outputElems[j]);
 		}
 
-		if (drawStyle == DrawStyle::TRIANGLES)
-			Rasterizer::drawTriangleSample(this, &ctx, outputElems);
-		else if (drawStyle == DrawStyle::TRIANGLES_WIREFRAME)
-			Rasterizer::drawTriangleWireframe(this, &ctx, outputElems);
+		if (activeProfiler)
+			shaded = FrameProfiler::Clock::now();
+
+		rasterKernel(this, &ctx, outputElems);
+
+		if (activeProfiler) {
+			vertexTime += shaded - start;
+			rasterTime += FrameProfiler::Clock::now() - shaded;
+		}
 
 		ctx.primitiveID++;
 	}
 
+	addDrawArgs(scope, size / 3, vertexTime, rasterTime);
+}
+
+void SoftwareRenderer::drawMeshlets(const MeshletMesh& mesh, const Eigen::Matrix4f& objectToClip)
+{
+	assert(this->pShader != nullptr && "No valid shader is bond!");
+
+	if (renderCondition && !renderCondition->anySamplesPassed() && !frameReplaying)
+		return;
+
+	const auto& indices = mesh.getIndices();
+
+	if (capture && !frameReplaying)
+		capture->recordMeshletDraw(pShader, getPipelineState()->getDesc(), pVertexArray, vertexArrayLength, mesh, objectToClip);
+
+	if (frameActive) {
+		recordCommand(FrameCommand::Type::DRAW, indices.data(), indices.size(), &mesh, objectToClip);
+		return;
+	}
+
+	const auto rasterKernel = getPipelineState()->getKernel();
+	assert((!pipeline->getDesc().zBufferEnabled || pipeline->getDesc().depthFormat == zBuffer->getFormat())
+		&& "Pipeline depth format does not match the depth buffer!");
+	updateVaryingLayout();
+
+	const auto& shaderDesc = pShader->getDesc();
+	std::size_t inputElemSize = shaderDesc.inputVertexSize;
+	float* decodedVertex = reserveDecodedVertex(shaderDesc);
+
+	const uint8_t* inputElems = reinterpret_cast<const uint8_t *>(pVertexArray);
+
+	Eigen::VectorXf outputElems[3];
+
+	RenderContext ctx;
+	ctx.renderer = this;
+
+	FrameProfiler* const activeProfiler = profiler && profiler->isCapturing() ? profiler.get() : nullptr;
+	FrameProfiler::Scope scope(activeProfiler, "drawMeshlets", "draw");
+	FrameProfiler::Clock::duration vertexTime{}, rasterTime{};
+	FrameProfiler::Clock::time_point start, shaded;
+	std::size_t triangles = 0;
+	std::size_t culledMeshlets = 0;
+
+	// Backfacing meshlets are only rejected when the pipeline would cull all their triangles
+	const bool backfaceCull = getPipelineState()->getDesc().backfaceCull;
+	const MeshletMesh::View view(objectToClip);
+
+	for (std::size_t m = 0; m < mesh.getMeshletCount(); ++m) {
+		const auto& meshlet = mesh.getMeshlet(m);
+		if (!view.isInsideFrustum(meshlet) || (backfaceCull && view.isBackFacing(meshlet))) {
+			culledMeshlets++;
+			continue;
+		}
+
+		if (activeProfiler)
+			start = FrameProfiler::Clock::now();
+
+		const uint32_t* vertexIndices = mesh.getMeshletVertices(meshlet);
+		if (meshletVertices.size() < meshlet.vertexCount)
+			meshletVertices.resize(meshlet.vertexCount);
+
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+			const std::size_t index = vertexIndices[i];
+			assert(index < vertexArrayLength && "Vertex array out of index!");
+
+			auto inputVertexData = vertexInput(shaderDesc, inputElems + index * inputElemSize, decodedVertex);
+			ctx.vertexID = static_cast<uint32_t>(index);
+			pShader->vertexShader(ctx, inputVertexData, meshletVertices[i]);
+		}
+
+		if (activeProfiler)
+			shaded = FrameProfiler::Clock::now();
+
+		const uint8_t* meshletTriangles = mesh.getMeshletTriangles(meshlet);
+		const uint32_t* primitives = mesh.getMeshletPrimitives(meshlet);
+
+		for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+			// The kernels divide their vertices in place
+			for (int j = 0; j < 3; ++j)
+				outputElems[j] = meshletVertices[meshletTriangles[3 * t + j]];
+
+			ctx.primitiveID = primitives[t];
+			rasterKernel(this, &ctx, outputElems);
+		}
+		triangles += meshlet.triangleCount;
+
+		if (activeProfiler) {
+			vertexTime += shaded - start;
+			rasterTime += FrameProfiler::Clock::now() - shaded;
+		}
+	}
+
+	addDrawArgs(scope, triangles, vertexTime, rasterTime);
+	scope.addArg("culledMeshlets", double(culledMeshlets));
+}
+
+float* SoftwareRenderer::reserveDecodedVertex(const IShader::ShaderDescriptor& desc)
+{
+	if (!desc.inputLayout)
+		return nullptr;
+
+	decodedVertex.resize(desc.inputLayout->getDecodedSize() / sizeof(float) + VertexLayout::DECODE_SLACK);
+	return decodedVertex.data();
+}
+
+void SoftwareRenderer::addDrawArgs(FrameProfiler::Scope& scope, std::size_t triangles,
+	FrameProfiler::Clock::duration vertexTime, FrameProfiler::Clock::duration rasterTime)
+{
+	using Millis = std::chrono::duration<double, std::milli>;
+
+	scope.addArg("triangles", double(triangles));
+	scope.addArg("vertexShadingMs", Millis(vertexTime).count());
+	scope.addArg("rasterizationMs", Millis(rasterTime).count());
+}
+
+void SoftwareRenderer::beginFrame()
+{
+	assert(!frameActive && "Frame already began!");
+	frameActive = true;
+
+	if (capture)
+		capture->recordOp(CaptureOp::BEGIN_FRAME);
+
+	frameCommands.clear();
+	frameConstants.clear();
+}
+
+bool SoftwareRenderer::endFrame()
+{
+	assert(frameActive && "No frame to end!");
+	frameActive = false;
+
+	if (capture && capture->endFrame())
+		capture.reset();
+
+	const Rect screen = { 0, 0, w, h };
+	dirtyRects.clear();
+
+	FrameProfiler* const activeProfiler = profiler && profiler->isCapturing() ? profiler.get() : nullptr;
+	FrameProfiler::Scope frameScope(activeProfiler, "endFrame", "frame");
+	frameScope.addArg("commands", double(frameCommands.size()));
+
+	saveShaderConstants();
+
+	{
+		FrameProfiler::Scope boundsScope(activeProfiler, "computeBounds", "frame");
+
+		// Commands are matched with the previous frame by submission order
+		for (std::size_t i = 0; i < frameCommands.size(); ++i) {
+			auto& command = frameCommands[i];
+
+			if (matchesLastFrame(i)) {
+				command.bounds = lastFrameCommands[i].bounds;
+				continue;
+			}
+
+			command.bounds = computeBounds(command);
+			addDirtyRect(command.bounds);
+			if (i < lastFrameCommands.size())
+				addDirtyRect(lastFrameCommands[i].bounds);
+		}
+
+		for (std::size_t i = frameCommands.size(); i < lastFrameCommands.size(); ++i)
+			addDirtyRect(lastFrameCommands[i].bounds);
+
+		if (frameInvalid) {
+			dirtyRects.assign(1, screen);
+			frameInvalid = false;
+		}
+	}
+
+	frameScope.addArg("dirtyRects", double(dirtyRects.size()));
+
+	const bool redrawn = !dirtyRects.empty();
+
+	if (redrawn) {
+		IShader* const savedShader = pShader;
+		const void* const savedVertexArray = pVertexArray;
+		const std::size_t savedVertexArrayLength = vertexArrayLength;
+		const auto savedPipeline = pipeline;
+		const auto savedPipelineDesc = pipelineDesc;
+		const bool savedPipelineDirty = pipelineDirty;
+		frameReplaying = true;
+
+		for (const Rect& rect : dirtyRects) {
+			FrameProfiler::Scope rectScope(activeProfiler, "redrawRect", "frame");
+			rectScope.addArg("x0", rect.x0);
+			rectScope.addArg("y0", rect.y0);
+			rectScope.addArg("x1", rect.x1);
+			rectScope.addArg("y1", rect.y1);
+
+			scissor = rect;
+			clearRect(rect);
+			zBuffer->clearRect(rect.x0, rect.y0, rect.x1, rect.y1);
+
+			for (const auto& command : frameCommands) {
+				if (command.type != FrameCommand::Type::DRAW || command.bounds.intersects(rect))
+					replayCommand(command, frameConstants);
+			}
+		}
+		scissor = screen;
+		frameReplaying = false;
+
+		for (const Rect& rect : dirtyRects)
+			resolveRect(rect);
+
+		pShader = savedShader;
+		pVertexArray = savedVertexArray;
+		vertexArrayLength = savedVertexArrayLength;
+		pipeline = savedPipeline;
+		pipelineDesc = savedPipelineDesc;
+		pipelineDirty = savedPipelineDirty;
+		varyingLayoutDirty = true;
+	}
+
+	restoreShaderConstants();
+
+	std::swap(frameCommands, lastFrameCommands);
+	std::swap(frameConstants, lastFrameConstants);
+	return redrawn;
+}
+
+void SoftwareRenderer::invalidateFrame()
+{
+	frameInvalid = true;
+
+	if (capture)
+		capture->recordOp(CaptureOp::INVALIDATE_FRAME);
+}
+
+void SoftwareRenderer::recordCommand(FrameCommand::Type type, const uint32_t* indices, std::size_t count,
+	const MeshletMesh* meshlets, const Eigen::Matrix4f& meshletTransform)
+{
+	FrameCommand command = {};
+	command.type = type;
+
+	uint64_t signature = hashValue(static_cast<int>(type), 0xCBF29CE484222325ull);
+
+	if (type == FrameCommand::Type::DRAW) {
+		const auto constants = pShader->getConstants();
+		const uint8_t* constantBytes = reinterpret_cast<const uint8_t*>(constants.data);
+
+		command.shader = pShader;
+		command.pipeline = getPipelineState();
+		command.hasConstants = constants.data != nullptr;
+		command.constantsOffset = frameConstants.size();
+		command.constantsSize = constants.data ? constants.size : 0;
+		frameConstants.insert(frameConstants.end(), constantBytes, constantBytes + command.constantsSize);
+		command.vertexArray = pVertexArray;
+		command.vertexArrayLength = vertexArrayLength;
+		command.indices = indices;
+		command.indexCount = count;
+		command.meshlets = meshlets;
+		command.meshletTransform = meshletTransform;
+
+		signature = hashValue(command.shader, signature);
+		signature = hashPipelineDesc(command.pipeline->getDesc(), signature);
+		signature = hashBytes(constants.data, command.constantsSize, signature);
+		signature = hashValue(vertexArrayLength, signature);
+		signature = hashBytes(pVertexArray, vertexArrayLength * pShader->getDesc().inputVertexSize, signature);
+		signature = hashValue(indices != nullptr, signature);
+		signature = hashValue(count, signature);
+		if (indices)
+			signature = hashBytes(indices, count * sizeof(uint32_t), signature);
+		signature = hashValue(meshlets, signature);
+		if (meshlets)
+			signature = hashBytes(meshletTransform.data(), sizeof(float) * 16, signature);
+	}
+
+	command.signature = signature;
+	frameCommands.push_back(command);
+}
+
+bool SoftwareRenderer::matchesLastFrame(std::size_t i) const
+{
+	if (i >= lastFrameCommands.size())
+		return false;
+
+	const auto& command = frameCommands[i];
+	const auto& last = lastFrameCommands[i];
+
+	if (command.signature != last.signature || command.type != last.type)
+		return false;
+	if (command.type != FrameCommand::Type::DRAW)
+		return true;
+
+	// The signature only rules out changes, everything kept from the previous frame is compared.
+	// Vertex and index contents are not copied, their pointers and counts are.
+	if (!command.hasConstants || !last.hasConstants)
+		return false;
+
+	return command.shader == last.shader &&
+		samePipelineDesc(command.pipeline->getDesc(), last.pipeline->getDesc()) &&
+		command.constantsSize == last.constantsSize &&
+		std::memcmp(frameConstants.data() + command.constantsOffset,
+			lastFrameConstants.data() + last.constantsOffset, command.constantsSize) == 0 &&
+		command.vertexArray == last.vertexArray && command.vertexArrayLength == last.vertexArrayLength &&
+		command.indices == last.indices && command.indexCount == last.indexCount &&
+		command.meshlets == last.meshlets &&
+		(!command.meshlets || command.meshletTransform == last.meshletTransform);
+}
+
+SoftwareRenderer::Rect SoftwareRenderer::computeBounds(const FrameCommand& command)
+{
+	const Rect screen = { 0, 0, w, h };
+
+	if (command.type != FrameCommand::Type::DRAW)
+		return { 0, 0, 0, 0 };
+
+	IShader* shader = command.shader;
+	if (command.hasConstants)
+		shader->setConstants(frameConstants.data() + command.constantsOffset, command.constantsSize);
+
+	const auto& desc = shader->getDesc();
+	const uint8_t* inputElems = reinterpret_cast<const uint8_t*>(command.vertexArray);
+	float* decodedVertex = reserveDecodedVertex(desc);
+
+	// Shading the whole array is cheaper when indices refer to vertices several times
+	const bool useIndices = command.indices && command.indexCount < command.vertexArrayLength;
+	const std::size_t count = useIndices ? command.indexCount : command.vertexArrayLength;
+
+	RenderContext ctx;
+	ctx.renderer = this;
+	Eigen::VectorXf vertexOut;
+
+	Eigen::Vector2f lower(FLT_MAX, FLT_MAX);
+	Eigen::Vector2f upper(-FLT_MAX, -FLT_MAX);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		const std::size_t index = useIndices ? command.indices[i] : i;
+
+		ctx.vertexID = static_cast<uint32_t>(i);
+		shader->vertexShader(ctx, vertexInput(desc, inputElems + index * desc.inputVertexSize, decodedVertex), vertexOut);
+
+		// Vertices are not clipped, so the projected positions bound everything rasterized
+		const Eigen::Vector4f position = desc.extractPosition(vertexOut);
+		if (!(fabsf(position.w()) > 1e-6f))
+			return screen;
+
+		const Eigen::Vector2f point(
+			(position.x() / position.w() + 1.0f) / 2 * w,
+			(position.y() / position.w() + 1.0f) / 2 * h);
+
+		lower = lower.cwiseMin(point);
+		upper = upper.cwiseMax(point);
+	}
+
+	if (!(lower.x() <= upper.x() && lower.y() <= upper.y()))
+		return count ? screen : Rect{ 0, 0, 0, 0 };
+
+	// One pixel of margin for the rounding of wireframe lines
+	lower = lower.cwiseMax(Eigen::Vector2f(-1.0f, -1.0f)) - Eigen::Vector2f(1.0f, 1.0f);
+	upper = upper.cwiseMin(Eigen::Vector2f(float(w), float(h))) + Eigen::Vector2f(2.0f, 2.0f);
+
+	const Rect bounds = {
+		int(floorf(lower.x())), int(floorf(lower.y())),
+		int(floorf(upper.x())), int(floorf(upper.y())),
+	};
+	return bounds.intersection(screen);
+}
+
+void SoftwareRenderer::replayCommand(const FrameCommand& command, const std::vector<uint8_t>& constants)
+{
+	if (command.type == FrameCommand::Type::CLEAR_DEPTH) {
+		zBuffer->clearRect(scissor.x0, scissor.y0, scissor.x1, scissor.y1);
+		return;
+	}
+
+	if (pShader != command.shader || pipeline != command.pipeline)
+		varyingLayoutDirty = true;
+
+	pShader = command.shader;
+	if (command.hasConstants)
+		pShader->setConstants(constants.data() + command.constantsOffset, command.constantsSize);
+	pipeline = command.pipeline;
+	pipelineDirty = false;
+	pVertexArray = command.vertexArray;
+	vertexArrayLength = command.vertexArrayLength;
+
+	if (command.meshlets)
+		drawMeshlets(*command.meshlets, command.meshletTransform);
+	else if (command.indices)
+		drawIndexed(command.indices, command.indexCount);
+	else
+		draw();
+}
+
+void SoftwareRenderer::saveShaderConstants()
+{
+	savedConstants.clear();
+	savedConstantBytes.clear();
+
+	for (const auto& command : frameCommands) {
+		if (command.type != FrameCommand::Type::DRAW || !command.hasConstants)
+			continue;
+
+		const auto saved = std::find_if(savedConstants.begin(), savedConstants.end(),
+			[&](const SavedConstants& s) { return s.shader == command.shader; });
+		if (saved != savedConstants.end())
+			continue;
+
+		const auto constants = command.shader->getConstants();
+		const uint8_t* constantBytes = reinterpret_cast<const uint8_t*>(constants.data);
+
+		savedConstants.push_back({ command.shader, savedConstantBytes.size(), constants.size });
+		savedConstantBytes.insert(savedConstantBytes.end(), constantBytes, constantBytes + constants.size);
+	}
+}
+
+void SoftwareRenderer::restoreShaderConstants()
+{
+	for (const auto& saved : savedConstants)
+		saved.shader->setConstants(savedConstantBytes.data() + saved.offset, saved.size);
+}
+
+void SoftwareRenderer::addDirtyRect(Rect rect)
+{
+	constexpr std::size_t maxDirtyRects = 16;
+
+	if (rect.empty())
+		return;
+
+	// Merge overlapping rectangles, the union may in turn overlap ones already checked
+	for (std::size_t i = 0; i < dirtyRects.size();) {
+		if (dirtyRects[i].intersects(rect)) {
+			rect = rect.united(dirtyRects[i]);
+			dirtyRects.erase(dirtyRects.begin() + i);
+			i = 0;
+		}
+		else {
+			++i;
+		}
+	}
+	dirtyRects.push_back(rect);
+
+	if (dirtyRects.size() > maxDirtyRects) {
+		for (const Rect& r : dirtyRects)
+			rect = rect.united(r);
+		dirtyRects.assign(1, rect);
+	}
+}
+
+void SoftwareRenderer::clearRect(const Rect& rect)
+{
+	if (rect.empty())
+		return;
+
+	const std::size_t bpp = PixelPacker::bytesPerPixel(format);
+
+	if (colorLayout == SurfaceLayout::TILED) {
+		// A row of the clear color, copied to every row of the rectangle
+		clearColorRow.resize(std::size_t(w) * bpp);
+		for (int x = 0; x < w; ++x)
+			PixelPacker::packColor(format, clearColor, clearColorRow.data() + x * bpp);
+
+		copyTiledRect<true>(format, colorTarget, colorAddressing, clearColorRow.data(), 0, rect.x0, h - rect.y1, rect.x1, h - rect.y0);
+		return;
+	}
+
+	const std::size_t rowBytes = std::size_t(rect.x1 - rect.x0) * bpp;
+
+	// Fill the first row by doubling, then copy it to the others
+	uint8_t* firstRow = frameBuffer + std::size_t(h - rect.y0 - 1) * pitch + rect.x0 * bpp;
+	PixelPacker::packColor(format, clearColor, firstRow);
+	for (std::size_t filled = bpp; filled < rowBytes;) {
+		const std::size_t n = std::min(filled, rowBytes - filled);
+		std::memcpy(firstRow + filled, firstRow, n);
+		filled += n;
+	}
+
+	for (int y = rect.y0 + 1; y < rect.y1; ++y)
+		std::memcpy(frameBuffer + std::size_t(h - y - 1) * pitch + rect.x0 * bpp, firstRow, rowBytes);
 }
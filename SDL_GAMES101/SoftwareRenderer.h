@@ -1,48 +1,232 @@
 #pragma once
 
 #include "IShader.h"
+#include "PixelFormat.h"
+#include "DepthBuffer.h"
+#include "PipelineState.h"
+#include "FrameProfiler.h"
+#include "Capture.h"
+#include "MeshletMesh.h"
+#include <memory>
+#include <vector>
+#include <algorithm>
 
 class SoftwareRenderer
 {
 	friend class Rasterizer;
 public:
-	enum class DrawStyle {
-		TRIANGLES,
-		TRIANGLES_WIREFRAME,
+	using DrawStyle = ::DrawStyle;
+
+	// Half-open pixel rectangle, in rasterizer coordinates (y going up)
+	struct Rect {
+		int x0, y0, x1, y1;
+
+		bool empty() const noexcept { return x0 >= x1 || y0 >= y1; }
+		bool intersects(const Rect& r) const noexcept {
+			return x0 < r.x1 && r.x0 < x1 && y0 < r.y1 && r.y0 < y1;
+		}
+		Rect intersection(const Rect& r) const noexcept {
+			return { std::max(x0, r.x0), std::max(y0, r.y0), std::min(x1, r.x1), std::min(y1, r.y1) };
+		}
+		Rect united(const Rect& r) const noexcept {
+			return { std::min(x0, r.x0), std::min(y0, r.y0), std::max(x1, r.x1), std::max(y1, r.y1) };
+		}
+	};
+
+	// Counts the samples of filled triangles passing the depth test, between beginQuery() and endQuery()
+	struct OcclusionQuery {
+		uint64_t samplesPassed = 0;
+
+		bool anySamplesPassed() const noexcept { return samplesPassed != 0; }
 	};
 
 private:
-	uint32_t* frameBuffer;
+	uint8_t* frameBuffer;
 	int w;
 	int h;
 	int pitch;
+	PixelFormat format;
+
+	// Colors are drawn to `colorTarget` at byte offsets from `colorAddressing`: the frame buffer
+	// itself, or in tiled layout an internal copy which resolve() detiles into the frame buffer
+	SurfaceLayout colorLayout = SurfaceLayout::LINEAR;
+	uint8_t* colorTarget;
+	SurfaceAddressing colorAddressing;
+	std::vector<uint8_t> tiledColor;
+	std::vector<uint8_t> clearColorRow;
 
 	IShader* pShader = nullptr;
 	const void* pVertexArray = nullptr;
 	std::size_t vertexArrayLength = 0;
-	DrawStyle drawStyle = DrawStyle::TRIANGLES;
-	bool backfaceCull = false;
-	uint8_t sampleDensity = 0;
-	std::vector<float> zBuffer;
-	bool zBufferEnabled = false;
-	bool perspectiveCorrectEnabled = false;
+	std::shared_ptr<DepthBuffer> zBuffer;
+
+	// State changed through the individual setters is baked into a new pipeline on the next draw
+	PipelineStateDesc pipelineDesc;
+	std::shared_ptr<const PipelineState> pipeline;
+	bool pipelineDirty = true;
+
+	// Shaded colors of the current scanline, packed to the target format once per row
+	std::vector<float> colorRow;
+	std::vector<uint8_t> colorRowMask;
+
+	// Input of the vertex shader when vertices are stored in a compressed layout
+	std::vector<float> decodedVertex;
+	// Outputs of the vertex shader for the vertices of one meshlet
+	std::vector<Eigen::VectorXf> meshletVertices;
+
+	// Depth tiles of the current triangle which are fully covered and pass the depth test
+	std::vector<uint8_t> acceptedTiles;
+
+	// Varyings of the bound shader as the bound pipeline interpolates them, rebuilt when either changes
+	VaryingLayout varyingLayout;
+	bool varyingLayoutDirty = true;
+	// Vertices of the current triangle packed to varyingLayout
+	Eigen::VectorXf packedVertices[3];
+
+	OcclusionQuery* activeQuery = nullptr;
+	const OcclusionQuery* renderCondition = nullptr;
+
+	std::shared_ptr<FrameProfiler> profiler;
+	std::unique_ptr<CaptureWriter> capture;
+
+	// Rasterization is limited to this rectangle, used to redraw dirty regions
+	Rect scissor;
+	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	// Between beginFrame() and endFrame() commands are recorded, compared against
+	// the previous frame, and only replayed over the regions they changed.
+	struct FrameCommand {
+		enum class Type {
+			DRAW,
+			CLEAR_DEPTH,
+		} type;
+
+		IShader* shader;
+		std::shared_ptr<const PipelineState> pipeline;
+		// Cleared when the shader does not expose its constants: the draw is redrawn every frame,
+		// with the constants the shader holds when the frame ends.
+		bool hasConstants;
+		std::size_t constantsOffset;
+		std::size_t constantsSize;
+		const void* vertexArray;
+		std::size_t vertexArrayLength;
+		const uint32_t* indices;
+		std::size_t indexCount;
+		// Set for drawMeshlets(), whose indices are those of the whole mesh. Unaligned, commands are kept in vectors.
+		const MeshletMesh* meshlets;
+		Eigen::Matrix<float, 4, 4, Eigen::DontAlign> meshletTransform;
+
+		uint64_t signature;
+		Rect bounds;
+	};
+
+	bool frameActive = false;
+	bool frameInvalid = true;
+	// Set while endFrame() replays recorded draws, which are not application calls
+	bool frameReplaying = false;
+	std::vector<FrameCommand> frameCommands;
+	std::vector<FrameCommand> lastFrameCommands;
+	std::vector<uint8_t> frameConstants;
+	std::vector<uint8_t> lastFrameConstants;
+	std::vector<Rect> dirtyRects;
+
+	// Constants the application left in the recorded shaders, put back once endFrame() is done with them
+	struct SavedConstants {
+		IShader* shader;
+		std::size_t offset;
+		std::size_t size;
+	};
+	std::vector<SavedConstants> savedConstants;
+	std::vector<uint8_t> savedConstantBytes;
+
+	void recordCommand(FrameCommand::Type type, const uint32_t* indices, std::size_t count,
+		const MeshletMesh* meshlets = nullptr, const Eigen::Matrix4f& meshletTransform = Eigen::Matrix4f::Identity());
+	bool matchesLastFrame(std::size_t i) const;
+	Rect computeBounds(const FrameCommand& command);
+	void replayCommand(const FrameCommand& command, const std::vector<uint8_t>& constants);
+	void saveShaderConstants();
+	void restoreShaderConstants();
+	void addDirtyRect(Rect rect);
+	void clearRect(const Rect& rect);
+	void updateVaryingLayout();
+	float* reserveDecodedVertex(const IShader::ShaderDescriptor& desc);
+	void updateColorTarget();
+	void resolveRect(const Rect& rect);
+	void addDrawArgs(FrameProfiler::Scope& scope, std::size_t triangles,
+		FrameProfiler::Clock::duration vertexTime, FrameProfiler::Clock::duration rasterTime);
 
 public:
 
 
-	SoftwareRenderer(uint32_t* frameBuffer, int w, int h, int pitch);
+	SoftwareRenderer(void* frameBuffer, int w, int h, int pitch, PixelFormat format = PixelFormat::BGRA8888);
 
 	void bindShader(IShader *pShader);
+	IShader* getShader() const noexcept { return pShader; }
+	void bindPipelineState(std::shared_ptr<const PipelineState> pipeline);
 	void setVertexArray(const void* vertexArray, std::size_t size);
 	void setDrawStyle(DrawStyle drawStyle);
 	void setBackfaceCull(bool enable);
 	void setSampleDensity(uint8_t density);
 	void setZBufferEnabled(bool enable);
 	void setPerspectiveCorrect(bool enable);
+	void setDepthFunc(DepthFunc func);
+	void setColorWrite(bool enable);
+	void setDepthWrite(bool enable);
+	void setClearColor(const Eigen::Vector4f& color);
+	// Clear color and depth
+	void clear();
 	void clearZBuffer();
-	std::vector<float>& getZbuffer();
+	// Depth buffers may be shared by renderers drawing to the same surface
+	void setDepthBuffer(std::shared_ptr<DepthBuffer> depthBuffer);
+	std::shared_ptr<DepthBuffer> getDepthBuffer();
+	PixelFormat getPixelFormat() const;
+	// Draws and frames are recorded into the profiler while it captures
+	void setProfiler(std::shared_ptr<FrameProfiler> profiler);
+	std::shared_ptr<FrameProfiler> getProfiler();
+	int getWidth() const noexcept { return w; }
+	int getHeight() const noexcept { return h; }
+	void* getFrameBuffer() const noexcept { return frameBuffer; }
+	int getPitch() const noexcept { return pitch; }
+
+	// Moves rendering to another surface of the same format, e.g. a scaled down one. A depth buffer of
+	// another size is replaced by a cleared one, and the next frame is redrawn entirely.
+	void setRenderTarget(void* frameBuffer, int w, int h, int pitch);
+
+	// Tiled layout keeps the pixels of a triangle in fewer cache lines, and needs a resolve pass to
+	// reach the frame buffer. endFrame() resolves what it redrew, draws outside frames need resolve().
+	void setColorLayout(SurfaceLayout layout);
+	SurfaceLayout getColorLayout() const noexcept { return colorLayout; }
+	void resolve();
+
+	std::shared_ptr<const PipelineState> getPipelineState();
+
+	// Serializes every following call and the data it reads to `path`, until `frames` frames ended.
+	// The first captured frame is redrawn entirely, so the capture does not depend on earlier ones.
+	bool startCapture(const char* path, int frames);
+	bool isCapturing() const noexcept { return capture != nullptr; }
+
+	// Draws issued until endFrame() are deferred. Their shader constants are captured,
+	// but the vertex and index arrays must stay alive and unchanged until endFrame().
+	void beginFrame();
+	// Returns false when the frame matched the previous one and the image was left untouched
+	bool endFrame();
+	// Forces the next frame to redraw everything, e.g. after the surface was written by someone else
+	void invalidateFrame();
+
+	// Results are ready as soon as endQuery() returns. Queries are not available inside frames,
+	// which only redraw the regions that changed.
+	void beginQuery(OcclusionQuery* query);
+	void endQuery();
+	// Draws are skipped while the query counted no sample, e.g. behind an occluded bounding box
+	void beginConditionalRender(const OcclusionQuery* query);
+	void endConditionalRender();
 
 	void draw();
 	void drawIndexed(const uint32_t* indices, std::size_t size);
+	// Draws the mesh meshlet by meshlet, skipping those outside the view or facing away before shading
+	// their vertices, which are shaded once per meshlet. `objectToClip` must be the transform the bound
+	// shader applies to the positions. The vertex ID is the index of the vertex in the vertex array,
+	// and the primitive ID the position of the triangle in the mesh index buffer.
+	void drawMeshlets(const MeshletMesh& mesh, const Eigen::Matrix4f& objectToClip);
 };
 
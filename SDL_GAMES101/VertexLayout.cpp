@@ -0,0 +1,220 @@
+#include "VertexLayout.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+static inline __m128i loadBits32(const uint8_t* data) {
+	uint32_t bits;
+	std::memcpy(&bits, data, sizeof(bits));
+	return _mm_cvtsi32_si128(static_cast<int>(bits));
+}
+
+// Half floats in the low 16 bits of each lane. The exponent is rebiased by a multiply,
+// which also turns half denormals into float normals; infinities and NaNs keep an all ones exponent.
+static inline __m128 halfToFloat(__m128i h) {
+	const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+	const __m128i magnitude = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+	const __m128 rebiased = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+	const __m128i infNaN = _mm_and_si128(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(0x7F800000));
+	return _mm_castsi128_ps(_mm_or_si128(_mm_or_si128(_mm_castps_si128(rebiased), infNaN), sign));
+}
+
+static inline __m128 snormToFloat(__m128i v, float maxValue) {
+	return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / maxValue)), _mm_set1_ps(-1.0f));
+}
+
+static inline uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	const float magnitude = std::fabs(value);
+
+	if (std::isnan(value))
+		return sign | 0x7E00;
+	if (magnitude >= 65520.0f)
+		return sign | 0x7C00;
+	if (magnitude < 6.103515625e-05f)
+		return sign | static_cast<uint16_t>(std::lround(magnitude * 16777216.0f));	// denormal, in units of 2^-24
+
+	// Round the mantissa to nearest even, a carry correctly bumps the exponent
+	uint32_t magnitudeBits = bits & 0x7FFFFFFF;
+	magnitudeBits += 0x0FFF + ((magnitudeBits >> 13) & 1);
+	return sign | static_cast<uint16_t>((magnitudeBits - 0x38000000) >> 13);
+}
+
+VertexLayout::VertexLayout(std::size_t stride, std::initializer_list<Attribute> attributes):
+	attributes(attributes), stride(stride), decodedSize(0)
+{
+	for (auto& attribute : this->attributes) {
+		const int count = componentCount(attribute.format);
+		assert(attribute.components >= 0 && attribute.components <= count && "Attribute has fewer components!");
+		assert(attribute.offset + formatSize(attribute.format) <= stride && "Attribute outside of the vertex!");
+
+		if (attribute.components == 0)
+			attribute.components = count;
+		decodedSize += attribute.components * sizeof(float);
+	}
+}
+
+int VertexLayout::componentCount(VertexFormat format) noexcept
+{
+	switch (format) {
+	case VertexFormat::FLOAT1:			return 1;
+	case VertexFormat::FLOAT2:			return 2;
+	case VertexFormat::FLOAT3:			return 3;
+	case VertexFormat::HALF2:
+	case VertexFormat::UNORM16x2:
+	case VertexFormat::SNORM16x2:		return 2;
+	case VertexFormat::FLOAT4:
+	case VertexFormat::HALF4:
+	case VertexFormat::UNORM8x4:
+	case VertexFormat::SNORM8x4:
+	case VertexFormat::UNORM16x4:
+	case VertexFormat::SNORM16x4:
+	case VertexFormat::SNORM10_10_10_2:	return 4;
+	}
+	return 0;
+}
+
+std::size_t VertexLayout::formatSize(VertexFormat format) noexcept
+{
+	switch (format) {
+	case VertexFormat::FLOAT1:			return 4;
+	case VertexFormat::FLOAT2:			return 8;
+	case VertexFormat::FLOAT3:			return 12;
+	case VertexFormat::FLOAT4:			return 16;
+	case VertexFormat::HALF2:			return 4;
+	case VertexFormat::HALF4:			return 8;
+	case VertexFormat::UNORM8x4:
+	case VertexFormat::SNORM8x4:		return 4;
+	case VertexFormat::UNORM16x2:
+	case VertexFormat::SNORM16x2:		return 4;
+	case VertexFormat::UNORM16x4:
+	case VertexFormat::SNORM16x4:		return 8;
+	case VertexFormat::SNORM10_10_10_2:	return 4;
+	}
+	return 0;
+}
+
+void VertexLayout::decode(const void* vertex, float* out) const noexcept
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(vertex);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (const auto& attribute : attributes) {
+		const uint8_t* data = bytes + attribute.offset;
+		__m128 value;
+
+		switch (attribute.format) {
+		case VertexFormat::FLOAT1:
+		case VertexFormat::FLOAT2:
+		case VertexFormat::FLOAT3:
+		case VertexFormat::FLOAT4:
+			std::memcpy(out, data, attribute.components * sizeof(float));
+			out += attribute.components;
+			continue;
+		case VertexFormat::HALF2:
+			value = halfToFloat(_mm_unpacklo_epi16(loadBits32(data), zero));
+			break;
+		case VertexFormat::HALF4:
+			value = halfToFloat(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), zero));
+			break;
+		case VertexFormat::UNORM8x4:
+			value = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(loadBits32(data), zero), zero)), _mm_set1_ps(1.0f / 255));
+			break;
+		case VertexFormat::SNORM8x4: {
+			// bytes to the top of each lane, then shifted back down with their sign
+			const __m128i spread = _mm_unpacklo_epi16(zero, _mm_unpacklo_epi8(zero, loadBits32(data)));
+			value = snormToFloat(_mm_srai_epi32(spread, 24), 127.0f);
+			break;
+		}
+		case VertexFormat::UNORM16x2:
+			value = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(loadBits32(data), zero)), _mm_set1_ps(1.0f / 65535));
+			break;
+		case VertexFormat::UNORM16x4:
+			value = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), zero)),
+				_mm_set1_ps(1.0f / 65535));
+			break;
+		case VertexFormat::SNORM16x2:
+			value = snormToFloat(_mm_srai_epi32(_mm_unpacklo_epi16(zero, loadBits32(data)), 16), 32767.0f);
+			break;
+		case VertexFormat::SNORM16x4:
+			value = snormToFloat(_mm_srai_epi32(_mm_unpacklo_epi16(zero, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data))), 16), 32767.0f);
+			break;
+		case VertexFormat::SNORM10_10_10_2: {
+			uint32_t bits;
+			std::memcpy(&bits, data, sizeof(bits));
+			// each field moved to the top of its lane, then shifted back down with its sign
+			const __m128i spread = _mm_set_epi32(int(bits), int(bits << 2), int(bits << 12), int(bits << 22));
+			const __m128i wMask = _mm_setr_epi32(0, 0, 0, -1);
+			const __m128i fields = _mm_or_si128(_mm_andnot_si128(wMask, _mm_srai_epi32(spread, 22)), _mm_and_si128(wMask, _mm_srai_epi32(spread, 30)));
+			const __m128 scaled = _mm_mul_ps(_mm_cvtepi32_ps(fields), _mm_setr_ps(1.0f / 511, 1.0f / 511, 1.0f / 511, 1.0f));
+			value = _mm_max_ps(scaled, _mm_set1_ps(-1.0f));
+			break;
+		}
+		default:
+			value = _mm_setzero_ps();
+			break;
+		}
+
+		_mm_storeu_ps(out, value);
+		out += attribute.components;
+	}
+}
+
+void VertexLayout::encode(VertexFormat format, const float* values, void* out) noexcept
+{
+	uint8_t* bytes = reinterpret_cast<uint8_t*>(out);
+	const int count = componentCount(format);
+
+	auto normalized = [&](int i, float maxValue, bool isSigned) {
+		const float v = std::min(std::max(values[i], isSigned ? -1.0f : 0.0f), 1.0f);
+		return static_cast<int>(std::lround(v * maxValue));
+	};
+
+	switch (format) {
+	case VertexFormat::FLOAT1:
+	case VertexFormat::FLOAT2:
+	case VertexFormat::FLOAT3:
+	case VertexFormat::FLOAT4:
+		std::memcpy(bytes, values, count * sizeof(float));
+		break;
+	case VertexFormat::HALF2:
+	case VertexFormat::HALF4:
+		for (int i = 0; i < count; ++i) {
+			const uint16_t half = floatToHalf(values[i]);
+			std::memcpy(bytes + i * sizeof(half), &half, sizeof(half));
+		}
+		break;
+	case VertexFormat::UNORM8x4:
+	case VertexFormat::SNORM8x4: {
+		const bool isSigned = format == VertexFormat::SNORM8x4;
+		for (int i = 0; i < count; ++i)
+			bytes[i] = static_cast<uint8_t>(normalized(i, isSigned ? 127.0f : 255.0f, isSigned));
+		break;
+	}
+	case VertexFormat::UNORM16x2:
+	case VertexFormat::UNORM16x4:
+	case VertexFormat::SNORM16x2:
+	case VertexFormat::SNORM16x4: {
+		const bool isSigned = format == VertexFormat::SNORM16x2 || format == VertexFormat::SNORM16x4;
+		for (int i = 0; i < count; ++i) {
+			const uint16_t packed = static_cast<uint16_t>(normalized(i, isSigned ? 32767.0f : 65535.0f, isSigned));
+			std::memcpy(bytes + i * sizeof(packed), &packed, sizeof(packed));
+		}
+		break;
+	}
+	case VertexFormat::SNORM10_10_10_2: {
+		const uint32_t packed =
+			(uint32_t(normalized(0, 511.0f, true)) & 0x3FF) |
+			((uint32_t(normalized(1, 511.0f, true)) & 0x3FF) << 10) |
+			((uint32_t(normalized(2, 511.0f, true)) & 0x3FF) << 20) |
+			((uint32_t(normalized(3, 1.0f, true)) & 0x3) << 30);
+		std::memcpy(bytes, &packed, sizeof(packed));
+		break;
+	}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+// Storage format of a vertex attribute. Normalized integers decode to [0, 1] or [-1, 1].
+enum class VertexFormat {
+	FLOAT1,
+	FLOAT2,
+	FLOAT3,
+	FLOAT4,
+	HALF2,
+	HALF4,
+	UNORM8x4,
+	SNORM8x4,
+	UNORM16x2,
+	UNORM16x4,
+	SNORM16x2,
+	SNORM16x4,
+	SNORM10_10_10_2,	// x, y, z in the low 30 bits, e.g. normals, and a 2-bit w
+};
+
+// Declares how compressed vertices are stored. Vertex shaders do not see the storage:
+// each vertex is decoded to consecutive floats, attribute after attribute, before they run.
+class VertexLayout
+{
+public:
+	struct Attribute {
+		VertexFormat format;
+		std::size_t offset;
+		// Floats written for the attribute, 0 for every component of its format
+		int components = 0;
+	};
+
+private:
+	std::vector<Attribute> attributes;
+	std::size_t stride;
+	std::size_t decodedSize;
+
+public:
+	VertexLayout(std::size_t stride, std::initializer_list<Attribute> attributes);
+
+	static int componentCount(VertexFormat format) noexcept;
+	static std::size_t formatSize(VertexFormat format) noexcept;
+
+	std::size_t getStride() const noexcept { return stride; }
+	// Bytes of floats a decoded vertex takes
+	std::size_t getDecodedSize() const noexcept { return decodedSize; }
+	const std::vector<Attribute>& getAttributes() const noexcept { return attributes; }
+
+	// Writes getDecodedSize() bytes to `out`. Attributes are decoded 4 components at a time,
+	// so `out` needs room for DECODE_SLACK more floats.
+	static constexpr std::size_t DECODE_SLACK = 3;
+	void decode(const void* vertex, float* out) const noexcept;
+
+	// Converts `componentCount(format)` floats to the format, for building compressed vertex arrays
+	static void encode(VertexFormat format, const float* values, void* out) noexcept;
+};
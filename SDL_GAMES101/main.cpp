@@ -4,9 +4,20 @@
 #include "ShaderUtils.h"
 #include "SoftwareRenderer.h"
 #include "RenderContext.h"
+#include "MeshLod.h"
+#include "MeshletMesh.h"
+#include "FrameProfiler.h"
+#include "Capture.h"
+#include "DynamicResolution.h"
+#include "SceneBvh.h"
+#include "FrameStream.h"
 
 #include <windows.h>
 #include <cmath>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <sstream>
 #include <iomanip>
 
@@ -54,7 +65,7 @@ mat4f make_ortho_matrix(float left, float right, float top, float bottom, float
 	Mortho <<
 		2 / (r - l), 0, 0, (r + l) / (l - r),
 		0, 2 / (t - b), 0, (t + b) / (b - t),
-		0, 0, 2 / (n - f), (n + f) / (f - n),
+		0, 0, 1 / (n - f), f / (f - n),
 		0, 0, 0, 1;
 
 	return Mortho;
@@ -74,10 +85,19 @@ mat4f make_prespective_matrix(float fovy, float aspect, float near, float far) {
 }
 
 class BoxDrawer {
+	// Corners are 0 or 1, stored as 8-bit normalized integers
+	static const VertexLayout& pointLayout() {
+		static const VertexLayout layout(sizeof(uint32_t), { { VertexFormat::UNORM8x4, 0, 3 } });
+		return layout;
+	}
+
 	class Shader : public IShader, private ShaderUtils {
 		mat4f modelview;
 
-		const ShaderDescriptor desc = {sizeof(v3f), 0};
+		const ShaderDescriptor desc = { pointLayout().getStride(), 0, false, &pointLayout(), {
+			Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED,
+			Interpolation::SMOOTH, Interpolation::SMOOTH, Interpolation::SMOOTH,
+		} };
 		const Eigen::Vector4f colorOfFaces[6] = {
 			{1.0f, 0.0f, 0.0f, 1.0f},
 			{0.0f, 1.0f, 0.0f, 1.0f},
@@ -91,6 +111,13 @@ class BoxDrawer {
 		const ShaderDescriptor& getDesc() noexcept final {
 			return desc;
 		}
+		ConstantBlock getConstants() noexcept final {
+			return { &modelview, sizeof(modelview) };
+		}
+		void setConstants(const void* data, std::size_t size) noexcept final {
+			assert(size == sizeof(modelview));
+			std::memcpy(static_cast<void*>(&modelview), data, size);
+		}
 		void vertexShader(const RenderContext &ctx, const void* inputDatas, Eigen::VectorXf &vertex_out) noexcept final {
 			auto &vertex_in = extractParam<v3f>(inputDatas);
 
@@ -121,6 +148,7 @@ class BoxDrawer {
 		{1.0f, 1.0f, 0.0f}, // 6
 		{1.0f, 1.0f, 1.0f}, // 7
 	};
+	uint32_t packed_points[8];
 
 	const uint32_t box_indices[36] = {
 		1,5,3,3,5,7,
@@ -138,17 +166,29 @@ public:
 	BoxDrawer(SDL_Surface *surface) {
 		renderer = std::make_unique<SoftwareRenderer>(reinterpret_cast<uint32_t*>(surface->pixels), surface->w, surface->h, surface->pitch);
 
-		//swrenderer.setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES_WIREFRAME);
-		renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES);
+		PipelineStateDesc state;
+		//state.drawStyle = DrawStyle::TRIANGLES_WIREFRAME;
+		state.drawStyle = DrawStyle::TRIANGLES;
+		state.backfaceCull = true;
+		state.zBufferEnabled = false;
+		state.perspectiveCorrect = false;
+		state.sampleDensity = 0;
+
+		for (int i = 0; i < 8; ++i) {
+			const float point[4] = { box_points[i].x(), box_points[i].y(), box_points[i].z(), 0.0f };
+			VertexLayout::encode(VertexFormat::UNORM8x4, point, &packed_points[i]);
+		}
+
 		renderer->bindShader(&shader);
-		renderer->setBackfaceCull(true);
-		renderer->setZBufferEnabled(false);
-		renderer->setPerspectiveCorrect(false);
-		renderer->setVertexArray(box_points, 8);
-		renderer->setSampleDensity(0);
+		renderer->bindPipelineState(PipelineState::create(state));
+		renderer->setVertexArray(packed_points, 8);
 	}
 
-	void draw(mat4f &trans) {
+	SoftwareRenderer& getRenderer() {
+		return *renderer;
+	}
+
+	bool draw(mat4f &trans) {
 
 		v3f camAt = { 0, 0, -5 };
 		v3f lookAt = (v3f(0.0f, 0.0f, 1.0f) - camAt).normalized();
@@ -159,25 +199,44 @@ public:
 		mat4f Mortho = make_prespective_matrix(PI * 60 / 360, 3.0f / 4.0f, -2, -10);
 		mat4f MVP = Mortho * Mview * trans;
 		shader.setModelView(MVP);
+		renderer->beginFrame();
 		renderer->clearZBuffer();
-		renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES);
 		renderer->drawIndexed(box_indices, 36);
-		//renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES_WIREFRAME);
-		//renderer->drawIndexed(box_indices, 36);
+		return renderer->endFrame();
 	}
 
 };
 
 class TriangleDrawer {
+	// What the vertex shader reads
 	struct Vertex {
 		Eigen::Vector2f pos;
 		Eigen::Vector3f color;
 	};
 
+	// What is stored: half float positions and 8-bit colors, 8 bytes instead of 20
+	struct PackedVertex {
+		uint16_t pos[2];
+		uint8_t color[4];
+	};
+
+	static const VertexLayout& vertexLayout() {
+		static const VertexLayout layout(sizeof(PackedVertex), {
+			{ VertexFormat::HALF2, offsetof(PackedVertex, pos) },
+			{ VertexFormat::UNORM8x4, offsetof(PackedVertex, color), 3 },
+		});
+		return layout;
+	}
+
 	class Shader : public IShader, private ShaderUtils {
-		const ShaderDescriptor desc = { sizeof(Vertex), 0 };
+		const ShaderDescriptor desc = { vertexLayout().getStride(), 0, false, &vertexLayout(), {
+			Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED,
+			Interpolation::SMOOTH, Interpolation::SMOOTH, Interpolation::SMOOTH,
+		} };
 	public:
 		const ShaderDescriptor& getDesc() noexcept final {return desc;}
+		// no constants
+		ConstantBlock getConstants() noexcept final {return { &desc, 0 };}
 
 		void vertexShader(const RenderContext &ctx, const void* inputDatas, Eigen::VectorXf& vertex_out) noexcept final {
 			auto input = extractParam<Vertex>(inputDatas);
@@ -198,21 +257,43 @@ class TriangleDrawer {
 		{{ 0.0f, -0.5f }, {0.0f, 0.0f, 1.0f}},
 		{{ 0.5f,  0.5f }, {0.0f, 1.0f, 0.0f}}, 
 	};
+	PackedVertex packedVertices[3];
 
 	Shader shader;
 	std::unique_ptr<SoftwareRenderer> renderer;
+	std::shared_ptr<const PipelineState> fillState;
+	std::shared_ptr<const PipelineState> wireframeState;
 public:
 	TriangleDrawer(SDL_Surface* surface) {
 		renderer = std::make_unique<SoftwareRenderer>(reinterpret_cast<uint32_t*>(surface->pixels), surface->w, surface->h, surface->pitch);
-		renderer->setBackfaceCull(true);
+
+		PipelineStateDesc state;
+		state.backfaceCull = true;
+		fillState = PipelineState::create(state);
+		state.drawStyle = DrawStyle::TRIANGLES_WIREFRAME;
+		wireframeState = PipelineState::create(state);
+
+		for (int i = 0; i < 3; ++i) {
+			const float color[4] = { vertices[i].color.x(), vertices[i].color.y(), vertices[i].color.z(), 1.0f };
+			VertexLayout::encode(VertexFormat::HALF2, vertices[i].pos.data(), packedVertices[i].pos);
+			VertexLayout::encode(VertexFormat::UNORM8x4, color, packedVertices[i].color);
+		}
+
 		renderer->bindShader(&shader);
-		renderer->setVertexArray(vertices, sizeof(vertices) / sizeof(Vertex));
+		renderer->setVertexArray(packedVertices, 3);
+	}
+
+	SoftwareRenderer& getRenderer() {
+		return *renderer;
 	}
-	void draw(mat4f& trans) {
-		renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES);
+
+	bool draw(mat4f& trans) {
+		renderer->beginFrame();
+		renderer->bindPipelineState(fillState);
 		renderer->draw();
-		renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES_WIREFRAME);
+		renderer->bindPipelineState(wireframeState);
 		renderer->draw();
+		return renderer->endFrame();
 	}
 };
 
@@ -223,14 +304,24 @@ class SphereDrawer {
 private:
 
 	class Shader : public IShader, private ShaderUtils {
-		const ShaderDescriptor desc = { sizeof(Vertex), 0 };
-		mat4f modelview;
+		const ShaderDescriptor desc = { sizeof(Vertex), 0, false, nullptr, {
+			Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED,
+			Interpolation::SMOOTH, Interpolation::SMOOTH, Interpolation::SMOOTH,
+			Interpolation::SMOOTH, Interpolation::SMOOTH, Interpolation::SMOOTH,
+		} };
 	public:
-
-		Eigen::Vector3f lightPosition;
-		Eigen::Vector3f cameraPosition;
+		struct Constants {
+			mat4f modelview;
+			Eigen::Vector3f lightPosition;
+			Eigen::Vector3f cameraPosition;
+		} constants = {};
 
 		const ShaderDescriptor& getDesc() noexcept final {return desc;}
+		ConstantBlock getConstants() noexcept final {return { &constants, sizeof(constants) };}
+		void setConstants(const void* data, std::size_t size) noexcept final {
+			assert(size == sizeof(constants));
+			std::memcpy(static_cast<void*>(&constants), data, size);
+		}
 
 		void vertexShader(const RenderContext &ctx, const void* inputDatas, Eigen::VectorXf& vertex_out) noexcept final {
 			auto input = extractParam<Vertex>(inputDatas);
@@ -242,7 +333,7 @@ private:
 			Eigen::Vector3f norm;
 			position.segment<3>(0) = input;
 			position.w() = 1.0;
-			position = modelview * position;
+			position = constants.modelview * position;
 			norm = input;
 
 			vertex_out.segment<4>(0) = position;
@@ -258,10 +349,10 @@ private:
 			Eigen::Vector3f norm = inputData.segment<3>(4).normalized();
 			Eigen::Vector3f world_pos = inputData.segment<3>(7);
 
-			const Eigen::Vector3f lightDirection = (lightPosition - world_pos).normalized();
-			const Eigen::Vector3f cameraDirection = (cameraPosition - world_pos).normalized();
+			const Eigen::Vector3f lightDirection = (constants.lightPosition - world_pos).normalized();
+			const Eigen::Vector3f cameraDirection = (constants.cameraPosition - world_pos).normalized();
 
-			const float lightDistance = (world_pos - lightPosition).norm();
+			const float lightDistance = (world_pos - constants.lightPosition).norm();
 
 			const Eigen::Vector3f h = (cameraDirection + lightDirection).normalized();
 
@@ -274,12 +365,16 @@ private:
 		}
 
 		void setModelView(mat4f& modelview) {
-			this->modelview = modelview;
+			constants.modelview = modelview;
 		}
 	};
 
 	std::vector<Eigen::Vector3f> vertices;
 	std::vector<uint32_t> indices;
+	std::unique_ptr<MeshLod> lod;
+	// Each level split into meshlets, so the back of the sphere is never shaded
+	std::vector<std::unique_ptr<MeshletMesh>> meshlets;
+	int lodLevel = 0;
 	Shader shader;
 
 public:
@@ -350,17 +445,32 @@ public:
 		indices.push_back(south_pole - longDiv);
 		indices.push_back(south_pole - 1);
 
-		shader.lightPosition = v3f(0.0f, 0.0f, 10.0f);
+		lod = std::make_unique<MeshLod>(vertices.data(), sizeof(Vertex), 0, vertices.size(), indices.data(), indices.size());
+		for (int level = 0; level < lod->getLevelCount(); ++level) {
+			const auto& levelIndices = lod->getLevel(level).indices;
+			meshlets.push_back(std::make_unique<MeshletMesh>(vertices.data(), sizeof(Vertex), 0, vertices.size(),
+				levelIndices.data(), levelIndices.size()));
+		}
+
+		shader.constants.lightPosition = v3f(0.0f, 0.0f, 10.0f);
+
+		PipelineStateDesc state;
+		state.drawStyle = DrawStyle::TRIANGLES;
+		state.backfaceCull = true;
+		state.sampleDensity = 0;
+		state.zBufferEnabled = false;
+		state.perspectiveCorrect = true;
 
 		renderer->bindShader(&shader);
-		renderer->setBackfaceCull(true);
+		renderer->bindPipelineState(PipelineState::create(state));
 		renderer->setVertexArray(vertices.data(), vertices.size());
-		renderer->setSampleDensity(0);
-		renderer->setZBufferEnabled(false);
-		renderer->setPerspectiveCorrect(true);
 	}
 
-	void draw(v3f camAt) {
+	SoftwareRenderer& getRenderer() {
+		return *renderer;
+	}
+
+	bool draw(v3f camAt) {
 		v3f lookAt = (v3f(0.0f, 0.0f, 0.0f) - camAt).normalized();
 		v3f upAt = lookAt.cross(v3f(0.0f, 1.0f, 0.0f)).cross(lookAt).normalized();
 
@@ -368,19 +478,274 @@ public:
 		//mat4f Mproj = make_ortho_matrix(-2, 2, 1.5, -1.5, -2, -10);
 		mat4f Mproj = make_prespective_matrix(PI * 60 / 360, 3.0f / 4.0f, -2, -10);
 		mat4f MVP = Mproj * Mview;
-		shader.cameraPosition = camAt;
+		shader.constants.cameraPosition = camAt;
 
 		shader.setModelView(MVP);
+		renderer->beginFrame();
 		//renderer->clearZBuffer();
-		renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES);
-		renderer->drawIndexed(indices.data(), indices.size());
-		//renderer->setDrawStyle(SoftwareRenderer::DrawStyle::TRIANGLES_WIREFRAME);
-		//renderer->drawIndexed(indices.data(), indices.size());
+		lodLevel = lod->selectLevel(MVP, renderer->getWidth(), renderer->getHeight(), lodLevel);
+		renderer->drawMeshlets(*meshlets[lodLevel], MVP);
+		return renderer->endFrame();
+	}
+
+};
+
+// A field of boxes, a few of them moving, with only those in the view frustum submitted
+class BoxFieldDrawer {
+	class Shader : public IShader, private ShaderUtils {
+		// Faces are shaded from the primitive ID, nothing is interpolated
+		const ShaderDescriptor desc = { sizeof(v3f), 0, false, nullptr, {
+			Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED, Interpolation::UNUSED,
+		} };
+	public:
+		struct Constants {
+			mat4f modelview;
+			v3f color;
+		} constants = {};
+
+		const ShaderDescriptor& getDesc() noexcept final { return desc; }
+		ConstantBlock getConstants() noexcept final { return { &constants, sizeof(constants) }; }
+		void setConstants(const void* data, std::size_t size) noexcept final {
+			assert(size == sizeof(constants));
+			std::memcpy(static_cast<void*>(&constants), data, size);
+		}
+
+		void vertexShader(const RenderContext& /*ctx*/, const void* inputDatas, Eigen::VectorXf& vertex_out) noexcept final {
+			auto& vertex_in = extractParam<v3f>(inputDatas);
+
+			vertex_out.resize(4);
+			vertex_out.segment<4>(0) = constants.modelview * v4f(vertex_in.x(), vertex_in.y(), vertex_in.z(), 1.0f);
+		}
+		void fragmentShader(const RenderContext& ctx, const Eigen::VectorXf& /*inputData*/, Eigen::Vector4f& color_out) noexcept final {
+			// faces are shaded by their direction
+			const float shade = 0.6f + 0.1f * (ctx.primitiveID / 4);
+			color_out.segment<3>(0) = constants.color * shade;
+			color_out(3) = 1.0f;
+		}
+	};
+
+	struct Box {
+		v3f position;
+		v3f color;
+		bool moving;
+		SceneBvh::ObjectId object;
+	};
+
+	const v3f box_points[8] = {
+		{0.0f, 0.0f, 0.0f},
+		{0.0f, 0.0f, 1.0f},
+		{0.0f, 1.0f, 0.0f},
+		{0.0f, 1.0f, 1.0f},
+		{1.0f, 0.0f, 0.0f},
+		{1.0f, 0.0f, 1.0f},
+		{1.0f, 1.0f, 0.0f},
+		{1.0f, 1.0f, 1.0f},
+	};
+
+	const uint32_t box_indices[36] = {
+		1,5,3,3,5,7,
+		5,4,7,7,4,6,
+		4,0,6,6,0,2,
+		0,1,3,3,2,0,
+		7,6,3,3,6,2,
+		0,4,1,1,4,5
+	};
+
+	static constexpr int fieldSize = 64;
+	static constexpr float boxSize = 0.3f;
+	static constexpr float spacing = 0.5f;
+
+	std::vector<Box> boxes;
+	std::vector<SceneBvh::ObjectId> visible;
+	SceneBvh scene;
+	Shader shader;
+	std::unique_ptr<SoftwareRenderer> renderer;
+	int frame = 0;
+
+	mat4f modelMatrix(const Box& box) const {
+		mat4f model = mat4f::Identity();
+		model.block<3, 3>(0, 0) *= boxSize;
+		model.block<3, 1>(0, 3) = box.position;
+		return model;
+	}
+
+	Aabb bounds(const Box& box) const {
+		return Aabb{ v3f::Zero(), v3f::Ones() }.transformed(modelMatrix(box));
+	}
+
+public:
+	BoxFieldDrawer(SDL_Surface* surface) {
+		renderer = std::make_unique<SoftwareRenderer>(reinterpret_cast<uint32_t*>(surface->pixels),
+			surface->w, surface->h, surface->pitch);
+
+		const float origin = -spacing * fieldSize / 2;
+		for (int y = 0; y < fieldSize; ++y) {
+			for (int x = 0; x < fieldSize; ++x) {
+				Box box;
+				box.position = v3f(origin + x * spacing, origin + y * spacing, -boxSize / 2);
+				box.color = v3f(float(x) / fieldSize, float(y) / fieldSize, 0.5f);
+				box.moving = (x + y) % 7 == 0;
+				box.object = scene.insert(bounds(box));
+				boxes.push_back(box);
+			}
+		}
+
+		PipelineStateDesc state;
+		state.drawStyle = DrawStyle::TRIANGLES;
+		state.backfaceCull = true;
+		state.zBufferEnabled = true;
+		state.perspectiveCorrect = false;
+		state.sampleDensity = 0;
+
+		renderer->bindShader(&shader);
+		renderer->bindPipelineState(PipelineState::create(state));
+		renderer->setVertexArray(box_points, 8);
+	}
+
+	SoftwareRenderer& getRenderer() {
+		return *renderer;
+	}
+
+	bool draw(v3f camAt) {
+		v3f lookAt = (v3f(0.0f, 0.0f, 0.0f) - camAt).normalized();
+		v3f upAt = lookAt.cross(v3f(0.0f, 1.0f, 0.0f)).cross(lookAt).normalized();
+
+		mat4f Mview = make_view_matrix(camAt, lookAt, upAt);
+		mat4f Mproj = make_prespective_matrix(PI * 60 / 360, 3.0f / 4.0f, -2, -10);
+		mat4f VP = Mproj * Mview;
+
+		// moving boxes refit the hierarchy above them
+		frame++;
+		for (auto& box : boxes) {
+			if (!box.moving)
+				continue;
+			box.position.z() = 0.5f * sinf(frame * 0.05f + box.position.x()) - boxSize / 2;
+			scene.update(box.object, bounds(box));
+		}
+
+		visible.clear();
+		scene.cull(Frustum(VP), visible);
+
+		renderer->beginFrame();
+		renderer->clearZBuffer();
+		for (auto object : visible) {
+			const Box& box = boxes[object];
+			shader.constants.modelview = VP * modelMatrix(box);
+			shader.constants.color = box.color;
+			renderer->drawIndexed(box_indices, 36);
+		}
+		return renderer->endFrame();
 	}
 
 };
 
+// Re-executes a capture written with the C key and reports its frame times, without opening a window
+int replayCapture(const char* path, int iterations) {
+	CaptureReplayer replayer;
+	if (!replayer.load(path)) {
+		printf("Cannot load capture %s\n", path);
+		return 1;
+	}
+
+	const int w = replayer.getWidth();
+	const int h = replayer.getHeight();
+	const int pitch = w * int(PixelPacker::bytesPerPixel(replayer.getPixelFormat()));
+	std::vector<uint8_t> pixels(std::size_t(h) * (pitch > w * 4 ? pitch : w * 4));
+
+	SDL_Surface surface = {};
+	surface.w = w;
+	surface.h = h;
+	surface.pitch = w * 4;
+	surface.pixels = pixels.data();
+
+	// The drawers are only built for their shaders
+	BoxDrawer box(&surface);
+	TriangleDrawer triangle(&surface);
+	SphereDrawer sphere(&surface, 10, 20);
+	BoxFieldDrawer field(&surface);
+	replayer.registerShader(box.getRenderer().getShader());
+	replayer.registerShader(triangle.getRenderer().getShader());
+	replayer.registerShader(sphere.getRenderer().getShader());
+	replayer.registerShader(field.getRenderer().getShader());
+
+	SoftwareRenderer renderer(pixels.data(), w, h, pitch, replayer.getPixelFormat());
+
+	std::vector<double> frameTimes;
+	std::string error;
+	double total = 0.0;
+	double best = 0.0;
+	std::size_t frames = 0;
+
+	for (int i = 0; i < iterations; ++i) {
+		if (!replayer.replay(renderer, frameTimes, error)) {
+			printf("Replay failed: %s\n", error.c_str());
+			return 1;
+		}
+		for (double time : frameTimes) {
+			total += time;
+			best = frames++ == 0 || time < best ? time : best;
+		}
+	}
+
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint8_t byte : pixels)
+		hash = (hash ^ byte) * 0x100000001B3ull;
+
+	printf("%zu frames, %.3f ms average, %.3f ms best, image %016llx\n",
+		frames, frames ? total / frames : 0.0, best, (unsigned long long)hash);
+	return 0;
+}
+
+// Renders an orbit around the sphere without a display, streamed as Y4M (or raw BGRA with "raw") to
+// `path`, "-" being the standard output: e.g. --stream - 600 | ffmpeg -i - orbit.mp4
+int streamFrames(const char* path, int frames, FrameStreamFormat format) {
+	const int w = 800;
+	const int h = 600;
+	std::vector<uint32_t> pixels(std::size_t(w) * h);
+
+	SDL_Surface surface = {};
+	surface.w = w;
+	surface.h = h;
+	surface.pitch = w * 4;
+	surface.pixels = pixels.data();
+
+	SphereDrawer renderer(&surface, 10, 20);
+
+	FrameStreamOptions options;
+	options.format = format;
+	FrameStream stream;
+	if (!stream.open(path, w, h, PixelFormat::BGRA8888, options)) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return 1;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < frames; ++i) {
+		const float yaw = i * (2.0f / 180.0f) * PI;
+		renderer.draw(AAf(yaw, v3f(0, 1, 0)) * v3f(0, 0, -5));
+		if (!stream.submit(surface.pixels, surface.pitch))
+			break;
+	}
+	const bool written = stream.close();
+
+	using Millis = std::chrono::duration<double, std::milli>;
+	const double total = Millis(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "%zu frames, %.3f ms per frame, %.3f ms waiting for the output\n",
+		stream.getFramesWritten(), total / (frames > 0 ? frames : 1), Millis(stream.getStallTime()).count());
+	if (!written) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		return 1;
+	}
+	return 0;
+}
+
 int main(int argc, char* args[]) {
+	if (argc >= 3 && std::strcmp(args[1], "--replay") == 0)
+		return replayCapture(args[2], argc >= 4 ? atoi(args[3]) : 10);
+	if (argc >= 3 && std::strcmp(args[1], "--stream") == 0)
+		return streamFrames(args[2], argc >= 4 ? atoi(args[3]) : 600,
+			argc >= 5 && std::strcmp(args[4], "raw") == 0 ? FrameStreamFormat::RAW : FrameStreamFormat::Y4M);
+
 	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
 
 	auto *screen = SDL_SetVideoMode(800, 600, 32, SDL_SWSURFACE);
@@ -390,18 +755,30 @@ int main(int argc, char* args[]) {
 
 	//BoxDrawer renderer(screen);
 	//TriangleDrawer renderer(screen);
+	//BoxFieldDrawer renderer(screen);
 	SphereDrawer renderer(screen, 10, 20);
 
 	uint32_t lastTime = 0, currentTime;
 	uint32_t fpsCount = 0;
 
+	// Press C to capture the next 60 frames, replayed with --replay frame_capture.bin
+	constexpr int captureFrames = 60;
+
+	// Press P to write the timeline and the shading cost heatmap of the next frame
+	auto profiler = std::make_shared<FrameProfiler>(screen->w, screen->h);
+	renderer.getRenderer().setProfiler(profiler);
+	bool captureFrame = false;
+
+	// Lowers the resolution of heavy frames to keep 60 FPS
+	DynamicResolution resolution(renderer.getRenderer());
+
 	for (;;) {
 		currentTime = SDL_GetTicks();
 		uint32_t timeElasped = currentTime - lastTime;
 		fpsCount++;
 		if (timeElasped >= 1000) {
 			std::stringstream ss;
-			ss << "Yiheng's Software Renderer - FPS: " << fpsCount;
+			ss << "Yiheng's Software Renderer - FPS: " << fpsCount << " - Scale: " << int(resolution.getScale() * 100 + 0.5f) << "%";
 			SDL_WM_SetCaption(ss.str().c_str(), nullptr);
 			
 			fpsCount = 0;
@@ -413,9 +790,26 @@ int main(int argc, char* args[]) {
 		camPosition = AAf(pitch, v3f(1, 0, 0)) * camPosition;
 		camPosition = AAf(yaw, v3f(0, 0, 1)) * camPosition;
 
-		SDL_FillRect(screen, nullptr, 0);
-		renderer.draw(camPosition);
-		SDL_Flip(screen);
+		if (captureFrame) {
+			// the whole frame is redrawn, so the capture shows its full cost
+			renderer.getRenderer().invalidateFrame();
+			profiler->beginCapture();
+		}
+
+		resolution.beginFrame();
+
+		// the previous image is kept when nothing changed
+		const bool redrawn = renderer.draw(camPosition);
+		resolution.present(redrawn);
+		if (redrawn)
+			SDL_Flip(screen);
+
+		if (captureFrame) {
+			profiler->endCapture();
+			profiler->writeTrace("frame_trace.json");
+			profiler->writeHeatmap("frame_heatmap.ppm", FrameProfiler::HeatmapMetric::SHADING_TIME);
+			captureFrame = false;
+		}
 
 		SDL_Event event;
 		SDL_PollEvent(&event);
@@ -439,6 +833,23 @@ int main(int argc, char* args[]) {
 			case SDLK_RIGHT:
 				pitch += (1.0f / 180.0f) * PI;
 				break;
+			case SDLK_p:
+				captureFrame = true;
+				break;
+			case SDLK_c:
+				if (!renderer.getRenderer().isCapturing())
+					renderer.getRenderer().startCapture("frame_capture.bin", captureFrames);
+				break;
+			case SDLK_t: {
+				// Toggle the tiled layout of the color and depth buffers
+				auto& target = renderer.getRenderer();
+				const auto depth = target.getDepthBuffer();
+				const SurfaceLayout layout = target.getColorLayout() == SurfaceLayout::LINEAR ? SurfaceLayout::TILED : SurfaceLayout::LINEAR;
+				target.setColorLayout(layout);
+				target.setDepthBuffer(std::make_shared<DepthBuffer>(target.getWidth(), target.getHeight(),
+					depth->getFormat(), depth->isTileCompressionEnabled(), layout));
+				break;
+			}
 
 
 			}